@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Microbenchmark of the hot paths of the inspection: segmentation, the three defect detectors, the measurement
+ * of the objects and the formatting of the InfluxDB points. Every stage runs on synthetic frames at several
+ * resolutions, and on frames of a recorded video when one is given.
+ * Reports the time and the heap allocations per call and the throughput, and can write them as JSON.
+ * Before the measurements it checks that the tracker inspects a wobbling object once, near the trigger line, and fails otherwise.
+ * It also fails when the closed form orientation and the PCA it replaced give different angles, and when the color table
+ * and the three passes it replaced give different masks.
+ * Usage: ./flaw-bench [-v video] [-n frames] [-i iterations] [-j results.json]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <nlohmann/json.hpp>
+#include "allocation_count.h"
+#include "inspection.h"
+#include "influxdb.h"
+#include "line_protocol.h"
+#include "tracker.h"
+
+using namespace cv;
+using namespace std;
+using json = nlohmann::json;
+
+// Largest difference allowed between the angles of the closed form orientation and of the PCA, in radians. They
+// solve the same eigenproblem and only differ by rounding, far below this
+static const double ORIENTATION_TOLERANCE = 1e-6;
+// Below this confidence an object is about round, its axis means nothing and the two angles are not compared
+static const double ORIENTATION_MIN_CONFIDENCE = 1e-3;
+
+/**
+ * @brief Frames of one resolution with the objects found on them
+ */
+struct FrameSet
+{
+    string source;
+    Size size;
+    vector<Mat> frames;
+    vector<ObjectSample> objects;
+};
+
+/**
+ * @brief Measured cost of one stage on one frame set
+ */
+struct Measurement
+{
+    string stage;
+    string source;
+    Size size;
+    long calls = 0;
+    double ns_per_call = 0;
+    double allocations_per_call = 0;
+    double pixels_per_call = 0;   // Pixels handled by one call, 0 for the stages not working on images
+};
+
+// Conveyor belt with bolts like the ones of the sample video: a good one, a rotated one, one of another color and a cracked one,
+// and optionally specks of dirt large enough to survive the morphology
+static Mat syntheticFrame(Size size, int seed, int specks = 0)
+{
+    Mat frame(size, CV_8UC3, Scalar(25, 25, 25));
+    RNG rng(seed);
+    const struct
+    {
+        double angle;
+        Scalar color;
+        bool crack;
+    } bolts[] = {{0, Scalar(150, 150, 150), false}, {35, Scalar(150, 150, 150), false},
+                 {0, Scalar(40, 90, 170), false}, {0, Scalar(150, 150, 150), true}};
+    int spacing = size.width / 4;
+
+    for (int i = 0; i < 4; i++)
+    {
+        Point center(spacing / 2 + i * spacing + rng.uniform(-10, 10), size.height / 2 + rng.uniform(-20, 20));
+        ellipse(frame, center, Size(min(90, spacing / 2 - 10), 30), bolts[i].angle, 0, 360, bolts[i].color, -1);
+        if (bolts[i].crack)
+            line(frame, center + Point(-15, -25), center + Point(15, 25), Scalar(10, 10, 10), 2);
+    }
+    for (int i = 0; i < specks; i++)
+        circle(frame, Point(rng.uniform(0, size.width), rng.uniform(0, size.height)), rng.uniform(3, 6), Scalar::all(140), -1);
+    // Sensor noise, so that the thresholds do not see perfectly flat regions
+    Mat noise(size, CV_8UC3);
+    randu(noise, Scalar::all(0), Scalar::all(8));
+    frame += noise;
+    return frame;
+}
+
+// Segment the frames of a set and keep the objects within the area limits, like the segmentation stage
+static void findSamples(FrameSet &set)
+{
+    for (size_t index = 0; index < set.frames.size(); index++)
+    {
+        auto contours = make_shared<vector<vector<Point>>>();
+        findObjects(set.frames[index], *contours);
+        for (size_t contour = 0; contour < contours->size(); contour++)
+        {
+            Rect object = boundingRect((*contours)[contour]);
+            if (object.width * object.height > OBJECT_AREA_MIN && OBJECT_AREA_MAX > object.width * object.height)
+            {
+                ObjectSample sample;
+                sample.frame = set.frames[index];
+                sample.object = object;
+                sample.roi = Rect(0, 0, sample.frame.cols, sample.frame.rows);
+                sample.contours = contours;
+                sample.contour_index = contour;
+                set.objects.push_back(sample);
+            }
+        }
+    }
+}
+
+// Move an object along the belt, its centroid wobbling 5 pixels either way and stepping back every other frame, and
+// return the samples the tracker hands over, with the number of tracks it took as started past the line
+static vector<ObjectSample> trackObject(int start_x, int speed, int &started_past)
+{
+    const int wobble[] = {0, -5, 5, -4, 4, -5, 3, -2};
+    const Size size(1920, 1080);
+    TrackerConfig config;
+    config.enabled = true;
+    CentroidTracker tracker(config);
+    vector<ObjectSample> inspected, ready;
+
+    for (int index = 0; start_x + index * speed < size.width - 200; index++)
+    {
+        ObjectSample sample;
+        sample.frame_index = index;
+        sample.object = Rect(start_x + index * speed + wobble[index % 8] - 50, 500, 100, 40);
+        tracker.update(vector<ObjectSample>(1, sample), size, ready);
+        inspected.insert(inspected.end(), ready.begin(), ready.end());
+    }
+    tracker.flush(ready);
+    inspected.insert(inspected.end(), ready.begin(), ready.end());
+    started_past = tracker.tracks_started_past();
+    return inspected;
+}
+
+// An object coming to the line is inspected once, within a step and a wobble of it, even though it steps back on
+// every other frame. An object first seen past the line is inspected once too
+static bool checkTracker()
+{
+    int started_past;
+    vector<ObjectSample> inspected = trackObject(660, 3, started_past);
+    float center = inspected.empty() ? 0 : inspected[0].object.x + inspected[0].object.width / 2.0f;
+    if (inspected.size() != 1 || started_past != 0 || fabs(center - 960) > 3 + 5)
+    {
+        cout << "The tracker inspected a wobbling object " << inspected.size() << " times, " << started_past
+             << " taken as started past the line, at " << center - 960 << " pixels from it" << endl;
+        return false;
+    }
+    inspected = trackObject(1000, 3, started_past);
+    if (inspected.size() != 1 || started_past != 1)
+    {
+        cout << "The tracker inspected an object started past the line " << inspected.size() << " times" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Run a call for a number of iterations after a warm up, and measure its time and allocations
+template <typename F>
+static Measurement measure(const string &stage, const FrameSet &set, int iterations, double pixels, F call)
+{
+    Measurement result;
+    result.stage = stage;
+    result.source = set.source;
+    result.size = set.size;
+    result.calls = iterations;
+    result.pixels_per_call = pixels;
+
+    call(0);
+    uint64_t before = processAllocations();
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        call(i);
+    double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    result.allocations_per_call = double(processAllocations() - before) / iterations;
+    result.ns_per_call = elapsed / iterations;
+    return result;
+}
+
+// Measure every stage on a frame set, and check that the replacements agree with the code they replaced
+static bool benchmarkSet(const FrameSet &set, int iterations, vector<Measurement> &results)
+{
+    double frame_pixels = set.size.area();
+    // Reused by the calls like the segmentation stage reuses the lists of its pool, so that only their own allocations count
+    vector<vector<Point>> contours;
+    // Every contour traced, against the blobs too small to be an object skipped
+    results.push_back(measure("segmentation all", set, iterations, frame_pixels, [&](int i)
+    {
+        findObjects(set.frames[i % set.frames.size()], contours);
+        return contours.size();
+    }));
+    results.push_back(measure("segmentation", set, iterations, frame_pixels, [&](int i)
+    {
+        findObjects(set.frames[i % set.frames.size()], contours, OBJECT_AREA_MIN);
+        int found = 0;
+        for (const auto &contour : contours)
+        {
+            Rect object = boundingRect(contour);
+            found += object.width * object.height > OBJECT_AREA_MIN && OBJECT_AREA_MAX > object.width * object.height;
+        }
+        return found;
+    }));
+    for (int scale : {2, 4})
+    {
+        results.push_back(measure("locateObjects 1/" + to_string(scale), set, iterations, frame_pixels, [&, scale](int i)
+        {
+            locateObjects(set.frames[i % set.frames.size()], scale, contours);
+            return contours.size();
+        }));
+    }
+
+    if (set.objects.empty())
+    {
+        cout << "No object found on the " << set.source << " frames at " << set.size.width << "x" << set.size.height
+             << ", skipping the detectors" << endl;
+        return true;
+    }
+    // The detectors are timed per object, cycling through all the objects of the set
+    auto object = [&](int i) -> const ObjectSample& { return set.objects[i % set.objects.size()]; };
+    double object_pixels = 0;
+    for (const auto &sample : set.objects)
+        object_pixels += sample.object.area();
+    object_pixels /= set.objects.size();
+
+    results.push_back(measure("detectOrientation", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return detectOrientation(sample.frame, (*sample.contours)[sample.contour_index], sample.object).defect;
+    }));
+    // The closed form orientation against the PCA of the contour points it replaced
+    results.push_back(measure("orientation PCA", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return getOrientation(createBuffer((*sample.contours)[sample.contour_index]));
+    }));
+    results.push_back(measure("orientation moments", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return contourOrientation((*sample.contours)[sample.contour_index]).angle;
+    }));
+    double largest_difference = 0;
+    for (const auto &sample : set.objects)
+    {
+        const vector<Point> &contour = (*sample.contours)[sample.contour_index];
+        ObjectOrientation orientation = contourOrientation(contour);
+        if (orientation.confidence < ORIENTATION_MIN_CONFIDENCE)
+            continue;
+        double difference = getOrientation(createBuffer(contour)) - orientation.angle;
+        largest_difference = max(largest_difference, fabs(remainder(difference, 2 * CV_PI)));
+    }
+    bool consistent = largest_difference <= ORIENTATION_TOLERANCE;
+    cout << "Orientation of the " << set.objects.size() << " objects of the " << set.source << " frames at " << set.size.width
+         << "x" << set.size.height << ": moments and PCA differ by at most " << largest_difference << " rad"
+         << (consistent ? "" : ", more than the tolerance") << endl;
+    results.push_back(measure("detectColor", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return detectColor(sample.frame, sample.object).defect;
+    }));
+    // The color table against the brightening, HSV conversion and range test it replaced
+    Mat bright, hsv, mask;
+    results.push_back(measure("color mask HSV", set, iterations, object_pixels, [&](int i)
+    {
+        Mat view = object(i).frame(object(i).object);
+        view.convertTo(bright, -1, 1, COLOR_BRIGHTNESS);
+        cvtColor(bright, hsv, COLOR_BGR2HSV);
+        inRange(hsv, Scalar(COLOR_LOW_H, COLOR_LOW_S, COLOR_LOW_V), Scalar(COLOR_HIGH_H, COLOR_HIGH_S, COLOR_HIGH_V), mask);
+        return mask.rows;
+    }));
+    results.push_back(measure("color mask table", set, iterations, object_pixels, [&](int i)
+    {
+        ColorTable::colorDefects().classify(object(i).frame(object(i).object), mask);
+        return mask.rows;
+    }));
+    long differing_pixels = 0;
+    for (const auto &sample : set.objects)
+    {
+        Mat view = sample.frame(sample.object), table_mask;
+        view.convertTo(bright, -1, 1, COLOR_BRIGHTNESS);
+        cvtColor(bright, hsv, COLOR_BGR2HSV);
+        inRange(hsv, Scalar(COLOR_LOW_H, COLOR_LOW_S, COLOR_LOW_V), Scalar(COLOR_HIGH_H, COLOR_HIGH_S, COLOR_HIGH_V), mask);
+        ColorTable::colorDefects().classify(view, table_mask);
+        differing_pixels += countNonZero(mask != table_mask);
+    }
+    // The table is built from the same three passes, so its masks have to be exactly theirs
+    if (differing_pixels > 0)
+        consistent = false;
+    cout << "Color masks of the " << set.objects.size() << " objects of the " << set.source << " frames at " << set.size.width
+         << "x" << set.size.height << ": table and HSV differ on " << differing_pixels << " pixels" << endl;
+    results.push_back(measure("detectCrack", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return detectCrack(sample.frame, sample.object).defect;
+    }));
+    results.push_back(measure("detectCrackInMask", set, iterations, object_pixels, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return detectCrackInMask(sample.frame, (*sample.contours)[sample.contour_index], sample.object).defect;
+    }));
+
+    vector<vector<Point>> corners;
+    for (const auto &sample : set.objects)
+    {
+        Point2f points[4];
+        minAreaRect((*sample.contours)[sample.contour_index]).points(points);
+        corners.push_back(vector<Point>(points, points + 4));
+    }
+    results.push_back(measure("find_dimensions", set, iterations * 100, 0, [&](int i)
+    {
+        return find_dimensions(corners[i % corners.size()], 0.0264583333);
+    }));
+    results.push_back(measure("measureObject", set, iterations * 10, 0, [&](int i)
+    {
+        const ObjectSample &sample = object(i);
+        return measureObject((*sample.contours)[sample.contour_index], 0.0264583333);
+    }));
+    return consistent;
+}
+
+// The points written for every object, formatted by the original Data query builder and by LineBuilder
+static void benchmarkPoints(int iterations, vector<Measurement> &results)
+{
+    FrameSet none;
+    none.source = "none";
+    results.push_back(measure("Data::build_query", none, iterations, 0, [](int i)
+    {
+        influx::Data point;
+        point.add_measure("Defect");
+        point.add_field("objectNumber", i);
+        point.add_field("crackDefect", i & 1);
+        point.add_field("orientationDefect", 0);
+        point.add_field("colorDefect", 1);
+        point.add_timestamp(influx::now_ns());
+        return point.build_query().size();
+    }));
+    influx::LineBuilder builder;
+    results.push_back(measure("LineBuilder", none, iterations, 0, [&](int i)
+    {
+        builder.clear();
+        builder.measure("Defect")
+               .field("objectNumber", i)
+               .field("crackDefect", i & 1)
+               .field("orientationDefect", 0)
+               .field("colorDefect", 1)
+               .timestamp(influx::now_ns());
+        return builder.str().size();
+    }));
+}
+
+static void writeJson(const string &path, const vector<Measurement> &results, int iterations)
+{
+    json report;
+    report["benchmark"] = "flaw-bench";
+    report["iterations"] = iterations;
+    report["opencv"] = CV_VERSION;
+#ifdef __VERSION__
+    report["compiler"] = __VERSION__;
+#endif
+    report["threads"] = getNumThreads();
+    report["results"] = json::array();
+    for (const auto &result : results)
+    {
+        json entry;
+        entry["stage"] = result.stage;
+        entry["source"] = result.source;
+        entry["width"] = result.size.width;
+        entry["height"] = result.size.height;
+        entry["calls"] = result.calls;
+        entry["ns_per_call"] = result.ns_per_call;
+        entry["allocations_per_call"] = result.allocations_per_call;
+        entry["calls_per_second"] = 1e9 / result.ns_per_call;
+        if (result.pixels_per_call > 0)
+            entry["megapixels_per_second"] = result.pixels_per_call / result.ns_per_call * 1e3;
+        report["results"].push_back(entry);
+    }
+    ofstream file(path);
+    file << report.dump(2) << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string video, json_path;
+    int recorded_frames = 8, iterations = 100, opt, status = EXIT_SUCCESS;
+    const Size sizes[] = {Size(640, 360), Size(1280, 720), Size(1920, 1080), Size(3840, 2160)};
+    vector<FrameSet> sets;
+    vector<Measurement> results;
+
+    while ((opt = getopt(argc, argv, "v:n:i:j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            video = optarg;
+            break;
+        case 'n':
+            recorded_frames = atoi(optarg);
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        default:
+            cout << "Usage: " << argv[0] << " [-v video] [-n frames] [-i iterations] [-j results.json]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!checkTracker())
+        return EXIT_FAILURE;
+
+    for (const Size &size : sizes)
+    {
+        FrameSet set;
+        set.source = "synthetic";
+        set.size = size;
+        for (int seed = 1; seed <= 4; seed++)
+            set.frames.push_back(syntheticFrame(size, seed));
+        sets.push_back(set);
+    }
+    {
+        // A belt covered in specks, to see the segmentation not slowing down with them
+        FrameSet set;
+        set.source = "cluttered";
+        set.size = Size(1920, 1080);
+        for (int seed = 1; seed <= 4; seed++)
+            set.frames.push_back(syntheticFrame(set.size, seed, 5000));
+        sets.push_back(set);
+    }
+    if (!video.empty())
+    {
+        // Every 40th frame, like the sampling of the application
+        VideoCapture capture(video);
+        FrameSet set;
+        Mat frame;
+        set.source = "recorded";
+        for (int index = 1; (int)set.frames.size() < recorded_frames && capture.read(frame); index++)
+        {
+            if (index % 40 == 0)
+                set.frames.push_back(frame.clone());
+        }
+        if (set.frames.empty())
+        {
+            cout << "Could not read any frame from " << video << endl;
+            return EXIT_FAILURE;
+        }
+        set.size = set.frames[0].size();
+        sets.push_back(set);
+    }
+
+    for (auto &set : sets)
+    {
+        findSamples(set);
+        if (!benchmarkSet(set, iterations, results))
+            status = EXIT_FAILURE;
+    }
+    benchmarkPoints(iterations * 100, results);
+
+    printf("%-20s %-10s %-10s %14s %12s %14s %10s\n", "stage", "source", "size", "ns/call", "allocs/call", "calls/s", "MPix/s");
+    for (const auto &result : results)
+    {
+        char size[16] = "-";
+        if (result.size.width > 0)
+            snprintf(size, sizeof(size), "%dx%d", result.size.width, result.size.height);
+        printf("%-20s %-10s %-10s %14.0f %12.1f %14.0f", result.stage.c_str(), result.source.c_str(), size,
+               result.ns_per_call, result.allocations_per_call, 1e9 / result.ns_per_call);
+        if (result.pixels_per_call > 0)
+            printf(" %10.1f\n", result.pixels_per_call / result.ns_per_call * 1e3);
+        else
+            printf(" %10s\n", "-");
+    }
+
+    // The stages which are not free of allocations once warmed up, most of them inside OpenCV
+    cout << "Allocations left per call:";
+    int allocating = 0;
+    for (const auto &result : results)
+    {
+        if (result.allocations_per_call < 0.01)
+            continue;
+        printf("%s %s (%s) %.1f", allocating++ % 4 == 0 ? "\n " : ",", result.stage.c_str(), result.source.c_str(), result.allocations_per_call);
+    }
+    cout << (allocating == 0 ? " none" : "") << endl;
+
+    if (!json_path.empty())
+    {
+        writeJson(json_path, results, iterations);
+        cout << "Results written to " << json_path << endl;
+    }
+    return status;
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Benchmark of the writes per second of the InfluxDB client, against a stub HTTP server on the loopback interface.
+ * Compares a client created for every write, a single long-lived client, and the asynchronous batched writer.
+ * Also compares the points serialized per second, and the allocations per point, of LineBuilder, of Data, and of Data
+ * as it was before, escaping with std::regex, kept here as the reference.
+ * Before the measurements it checks that LineBuilder formats the fields like Data, and that the three give the same
+ * points with keys to escape, and fails otherwise.
+ * Usage: ./influx-bench [writes]
+ */
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <regex>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "allocation_count.h"
+#include "influx_writer.h"
+
+using namespace std;
+
+/**
+ * @brief Minimal HTTP/1.1 server answering every request with 204 No Content, like the InfluxDB write endpoint
+ */
+class StubServer
+{
+    private:
+        int listener = -1;
+        int server_port = 0;
+        thread acceptor;
+
+        void serve(int connection)
+        {
+            string buffer;
+            char chunk[4096];
+            const char reply[] = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+
+            for (;;)
+            {
+                size_t header_end;
+                while ((header_end = buffer.find("\r\n\r\n")) == string::npos)
+                {
+                    ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+                    if (received <= 0)
+                    {
+                        close(connection);
+                        return;
+                    }
+                    buffer.append(chunk, received);
+                }
+
+                size_t body_length = 0, field = buffer.find("Content-Length:");
+                if (field != string::npos && field < header_end)
+                    body_length = strtoul(buffer.c_str() + field + 15, nullptr, 10);
+                while (buffer.size() < header_end + 4 + body_length)
+                {
+                    ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+                    if (received <= 0)
+                    {
+                        close(connection);
+                        return;
+                    }
+                    buffer.append(chunk, received);
+                }
+                buffer.erase(0, header_end + 4 + body_length);
+                requests++;
+                send(connection, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+            }
+        }
+
+    public:
+        atomic<int> connections;
+        atomic<int> requests;
+
+        StubServer() : connections(0), requests(0)
+        {
+            sockaddr_in address;
+            socklen_t length = sizeof(address);
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+
+            listener = socket(AF_INET, SOCK_STREAM, 0);
+            bind(listener, (sockaddr *)&address, sizeof(address));
+            listen(listener, 64);
+            getsockname(listener, (sockaddr *)&address, &length);
+            server_port = ntohs(address.sin_port);
+
+            acceptor = thread([this] {
+                int connection;
+                while ((connection = accept(listener, nullptr, nullptr)) >= 0)
+                {
+                    connections++;
+                    thread(&StubServer::serve, this, connection).detach();
+                }
+            });
+        }
+
+        ~StubServer()
+        {
+            shutdown(listener, SHUT_RDWR);
+            close(listener);
+            acceptor.join();
+        }
+
+        int port() const { return server_port; }
+};
+
+/**
+ * @brief Data as it was before its escaping was replaced by the single scan of LineBuilder: one std::regex replacement
+ * per kind of character to escape, and one string per key, value and field. Only what the benchmark uses is kept
+ */
+class RegexData
+{
+    private:
+        std::string measure;
+        std::string tag_data;
+        std::vector<std::string> field_data;
+        long long time = 0;
+
+        static std::string add_escape_seq(std::string data, bool measure)
+        {
+            std::string _data = data;
+            if (data.find_first_of(",") != std::string::npos)
+                _data = std::regex_replace(_data, std::regex(","), "\\,");
+            if (data.find_first_of(" ") != std::string::npos)
+                _data = std::regex_replace(_data, std::regex(" "), "\\ ");
+            if (data.find_first_of("=") != std::string::npos && !measure)
+                _data = std::regex_replace(_data, std::regex("="), "\\=");
+            return _data;
+        }
+
+    public:
+        void add_measure(const std::string& value) { measure = add_escape_seq(value, true); }
+
+        void add_tag(const std::string& key, const std::string& value)
+        {
+            tag_data = tag_data + "," + add_escape_seq(key, false) + "=" + add_escape_seq(value, false);
+        }
+
+        void add_field(const std::string& key, int value)
+        {
+            field_data.push_back(add_escape_seq(key, false) + "=" + std::to_string(value));
+        }
+
+        void add_timestamp(long long _time) { time = _time; }
+
+        std::string build_query() const
+        {
+            std::string _query;
+            for (auto field : field_data)
+            {
+                if (_query.empty())
+                {
+                    _query = field;
+                    continue;
+                }
+                _query = _query + "," + field;
+            }
+            return measure + tag_data + " " + _query + " " + std::to_string(time);
+        }
+};
+
+// A Defect point, with a tag and a field whose keys and value have characters to escape
+template <typename D>
+static void fillPoint(D &data, int object)
+{
+    data.add_measure("Defect");
+    data.add_tag("line id", "belt 1,left=a");
+    data.add_field("objectNumber", object);
+    data.add_field("crackDefect", object % 2);
+    data.add_field("orientationDefect", 0);
+    data.add_field("colorDefect", object % 3 == 0);
+    data.add_field("area=px, max", 9000);
+}
+
+static void fillPoint(influx::LineBuilder &point, int object)
+{
+    point.measure("Defect")
+         .tag("line id", "belt 1,left=a")
+         .field("objectNumber", object)
+         .field("crackDefect", object % 2)
+         .field("orientationDefect", 0)
+         .field("colorDefect", object % 3 == 0)
+         .field("area=px, max", 9000);
+}
+
+static void report(const char *name, int writes, double seconds, StubServer &server)
+{
+    cout << name << ": " << writes / seconds << " writes/s, "
+         << server.connections << " connections for " << server.requests << " requests" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int writes = argc > 1 ? atoi(argv[1]) : 2000;
+    int points = 1000000;
+
+    // LineBuilder has to format the fields like Data, including the doubles too large for its stack buffer
+    for (double value : {0.0, 0.5, -2.25, 123456.789, 1e300, -1e300})
+    {
+        influx::Data data;
+        data.add_measure("Check");
+        data.add_field("value", value);
+        data.add_timestamp(1);
+        influx::LineBuilder point;
+        point.measure("Check").field("value", value).timestamp(1);
+        if (point.str() != data.build_query() || point.str().find("value= ") != string::npos)
+        {
+            cout << "LineBuilder formats " << value << " as \"" << point.str() << "\" instead of \"" << data.build_query() << "\"" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    {
+        // The three serializers have to give the same points, escaping included
+        RegexData reference;
+        influx::Data data;
+        influx::LineBuilder point;
+        fillPoint(reference, 7);
+        reference.add_timestamp(1);
+        fillPoint(data, 7);
+        data.add_timestamp(1);
+        fillPoint(point, 7);
+        point.timestamp(1);
+        if (data.build_query() != reference.build_query() || point.str() != reference.build_query())
+        {
+            cout << "The points differ: \"" << reference.build_query() << "\" with regex escaping, \"" << data.build_query()
+                 << "\" with Data and \"" << point.str() << "\" with LineBuilder" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        // Serialization with Data as it was, escaping with std::regex
+        long long time = influx::now_ns();
+        size_t bytes = 0;
+        uint64_t before = processAllocations();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < points; i++)
+        {
+            RegexData data;
+            fillPoint(data, i);
+            data.add_timestamp(time + i);
+            bytes += data.build_query().size();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Data with regex:   " << points / seconds << " points/s, "
+             << double(processAllocations() - before) / points << " allocations/point (" << bytes << " bytes)" << endl;
+    }
+
+    {
+        // Serialization with Data: regex free escaping but one string per key, value and query
+        long long time = influx::now_ns();
+        size_t bytes = 0;
+        uint64_t before = processAllocations();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < points; i++)
+        {
+            influx::Data data;
+            fillPoint(data, i);
+            data.add_timestamp(time + i);
+            bytes += data.build_query().size();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Data::build_query: " << points / seconds << " points/s, "
+             << double(processAllocations() - before) / points << " allocations/point (" << bytes << " bytes)" << endl;
+    }
+
+    {
+        // Serialization with LineBuilder into a reused buffer
+        long long time = influx::now_ns();
+        size_t bytes = 0;
+        influx::LineBuilder point;
+        uint64_t before = processAllocations();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < points; i++)
+        {
+            point.clear();
+            fillPoint(point, i);
+            point.timestamp(time + i);
+            bytes += point.str().size();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "LineBuilder:       " << points / seconds << " points/s, "
+             << double(processAllocations() - before) / points << " allocations/point (" << bytes << " bytes)" << endl;
+    }
+
+    {
+        // A client for every write, as each object used to create its own
+        StubServer server;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < writes; i++)
+        {
+            influx::InfluxDB db("127.0.0.1", server.port());
+            influx::Data data;
+            fillPoint(data, i);
+            db.write_point("Defect", data);
+        }
+        report("client per write", writes, chrono::duration<double>(chrono::steady_clock::now() - start).count(), server);
+    }
+
+    {
+        // One long-lived client reusing its connection
+        StubServer server;
+        influx::InfluxDB db("127.0.0.1", server.port());
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < writes; i++)
+        {
+            influx::Data data;
+            fillPoint(data, i);
+            db.write_point("Defect", data);
+        }
+        report("persistent client", writes, chrono::duration<double>(chrono::steady_clock::now() - start).count(), server);
+    }
+
+    for (int gzip = 0; gzip < 2; gzip++)
+    {
+        // Points queued to the asynchronous writer, the time includes sending the last batch
+        StubServer server;
+        influx::InfluxDB db("127.0.0.1", server.port());
+        influx::WriterConfig config;
+        config.gzip = gzip;
+        auto start = chrono::steady_clock::now();
+        {
+            influx::AsyncWriter writer(db, "Defect", config);
+            for (int i = 0; i < writes; i++)
+            {
+                influx::Data data;
+                fillPoint(data, i);
+                writer.write(data);
+            }
+        }
+        report(gzip ? "async writer, gzip" : "async writer", writes, chrono::duration<double>(chrono::steady_clock::now() - start).count(), server);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Microbenchmark of the fused opening and closing against the sequence of OpenCV erode and dilate calls.
+ * Usage: ./morphology-bench [iterations]
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "morphology.h"
+
+using namespace cv;
+using namespace std;
+
+// Mask looking like the thresholded conveyor belt: a few large blobs and some speckle noise
+static Mat syntheticMask(Size size)
+{
+    Mat mask = Mat::zeros(size, CV_8UC1);
+    RNG rng(12345);
+    for (int i = 0; i < 6; i++)
+    {
+        Point center(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        Size axes(rng.uniform(40, 200), rng.uniform(20, 80));
+        ellipse(mask, center, axes, rng.uniform(0, 180), 0, 360, Scalar(255), -1);
+    }
+    for (int i = 0; i < size.area() / 200; i++)
+        mask.at<uchar>(rng.uniform(0, size.height), rng.uniform(0, size.width)) ^= 255;
+    return mask;
+}
+
+// Average time of one call in nanoseconds
+template <typename F>
+static double timeCall(F call, int iterations)
+{
+    call();
+    int64 start = getTickCount();
+    for (int i = 0; i < iterations; i++)
+        call();
+    return (getTickCount() - start) * 1e9 / getTickFrequency() / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    const Size sizes[] = {Size(1280, 720), Size(1920, 1080)};
+    int status = EXIT_SUCCESS;
+
+    for (const Size &size : sizes)
+    {
+        Mat mask = syntheticMask(size), reference, fused;
+
+        openCloseReference(mask, reference);
+        openClose(mask, fused);
+        bool identical = countNonZero(reference != fused) == 0;
+        if (!identical)
+            status = EXIT_FAILURE;
+
+        double reference_ns = timeCall([&] { openCloseReference(mask, reference); }, iterations);
+        double fused_ns = timeCall([&] { openClose(mask, fused); }, iterations);
+
+        cout << size.width << "x" << size.height
+             << "  erode/dilate: " << reference_ns / 1000 << " us"
+             << "  fused: " << fused_ns / 1000 << " us"
+             << "  speedup: " << reference_ns / fused_ns << "x"
+             << "  identical: " << (identical ? "yes" : "NO") << endl;
+    }
+    return status;
+}
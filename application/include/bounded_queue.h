@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the bounded queue connecting the stages of the pipeline
+ */
+
+# pragma once
+# include <condition_variable>
+# include <cstddef>
+# include <mutex>
+# include <vector>
+
+/**
+ * @brief Thread safe FIFO queue with a fixed capacity.
+ * A producer blocks in push() while the queue is full, which gives backpressure to the upstream stage.
+ * The items are held in a ring of slots allocated once, so queuing an item does not allocate.
+ */
+template <typename T>
+class BoundedQueue
+{
+    private:
+        std::vector<T> items;
+        size_t capacity;
+        size_t head = 0;
+        size_t count = 0;
+        bool closed = false;
+        std::mutex lock;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+
+        // Move out the oldest item and empty its slot, so that the slot does not keep a frame alive
+        void take(T &item)
+        {
+            item = std::move(items[head]);
+            items[head] = T();
+            head = (head + 1) % capacity;
+            count--;
+        }
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param capacity - Maximum number of items held by the queue
+         */
+        explicit BoundedQueue(size_t capacity) : items(capacity > 0 ? capacity : 1), capacity(capacity > 0 ? capacity : 1) {}
+
+        /**
+         * @brief Add an item, waiting for room if the queue is full
+         * @param item - Item to be added
+         * @return false if the queue has been closed
+         */
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            not_full.wait(guard, [this] { return closed || count < capacity; });
+            if (closed)
+                return false;
+            items[(head + count++) % capacity] = std::move(item);
+            not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Add an item only if there is room for it
+         * @param item - Item to be added
+         * @return false if the queue is full or has been closed
+         */
+        bool try_push(T item)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (closed || count >= capacity)
+                return false;
+            items[(head + count++) % capacity] = std::move(item);
+            not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest item, waiting for one if the queue is empty
+         * @param item - Receives the removed item
+         * @return false once the queue is closed and drained
+         */
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            not_empty.wait(guard, [this] { return closed || count > 0; });
+            if (count == 0)
+                return false;
+            take(item);
+            not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest item only if there is one
+         * @param item - Receives the removed item
+         * @return false if the queue is empty
+         */
+        bool try_pop(T &item)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (count == 0)
+                return false;
+            take(item);
+            not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief True once the queue is closed and all its items have been popped
+         */
+        bool drained()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return closed && count == 0;
+        }
+
+        /**
+         * @brief Close the queue. Waiting producers and consumers are woken up,
+         * the items already queued can still be popped
+         */
+        void close()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+        /**
+         * @brief Drop all the queued items
+         */
+        void clear()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            while (count > 0)
+            {
+                T item;
+                take(item);
+            }
+            not_full.notify_all();
+        }
+
+        /**
+         * @brief Number of items currently queued
+         */
+        size_t size()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return count;
+        }
+};
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the pools recycling the frames and the contours of the pipeline from one frame to the next
+ */
+
+# pragma once
+# include <atomic>
+# include <cstddef>
+# include <memory>
+# include <vector>
+# include <opencv2/core/core.hpp>
+
+/**
+ * @brief True if the pixels of a frame belong to memory the pipeline does not own, like a slot of a shared memory ring.
+ * Such a frame holds its slot for as long as it lives, so it must not be kept beyond the capture and the segmentation
+ */
+inline bool isBorrowed(const cv::Mat &frame)
+{
+    return frame.allocator != nullptr && frame.allocator != cv::Mat::getStdAllocator();
+}
+
+/**
+ * @brief Pixel buffers of the frames, reused once no stage holds them anymore.
+ * A frame is shared by reference counting with the later stages, the display and the image writer,
+ * so a buffer is free again when the pool holds its only reference.
+ * Only the capture thread uses the pool; the other threads only release their references.
+ */
+class FramePool
+{
+    private:
+        std::vector<cv::Mat> frames;
+        size_t capacity;
+
+        static bool isFree(const cv::Mat &frame)
+        {
+            return frame.u != nullptr && CV_XADD(&frame.u->refcount, 0) == 1;
+        }
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param capacity - Maximum number of buffers kept, about the number of frames in flight
+         */
+        explicit FramePool(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+        /**
+         * @brief Buffer to read the next frame into
+         * @return A buffer no stage uses anymore, or an empty Mat if they are all in use
+         */
+        cv::Mat acquire()
+        {
+            for (auto &frame : frames)
+                if (isFree(frame))
+                    return frame;
+            return cv::Mat();
+        }
+
+        /**
+         * @brief Keep the buffer of a frame, to reuse it once the later stages release it
+         * @param frame - Frame just read. Nothing is done if its buffer is already in the pool
+         */
+        void keep(const cv::Mat &frame)
+        {
+            // Frames wrapping memory the pool does not own, like the slots of a shared memory ring, are never kept
+            if (isBorrowed(frame))
+                return;
+            for (auto &kept : frames)
+                if (kept.u == frame.u)
+                    return;
+            if (frames.size() < capacity)
+            {
+                frames.push_back(frame);
+                return;
+            }
+            // The pool is full of buffers in use, or of a size the stream no longer has
+            for (auto &kept : frames)
+                if (isFree(kept))
+                {
+                    kept = frame;
+                    return;
+                }
+        }
+};
+
+/**
+ * @brief Objects handed to the later stages by shared pointer, reused once none of them holds the object anymore.
+ * A reused object keeps the memory it had grown, so a vector refilled with about as many items does not allocate.
+ * All the objects are created up front; one is only allocated when they are all in use, and then not kept.
+ * Only one thread acquires from the pool.
+ */
+template <typename T>
+class SharedPool
+{
+    private:
+        std::vector<std::shared_ptr<T>> items;
+        size_t capacity;
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param capacity - Number of objects kept, about the number of them in flight
+         */
+        explicit SharedPool(size_t capacity) : capacity(capacity > 0 ? capacity : 1)
+        {
+            for (size_t i = 0; i < this->capacity; i++)
+                items.push_back(std::make_shared<T>());
+        }
+
+        /**
+         * @brief An object no one else holds, or a new one if they are all in use
+         */
+        std::shared_ptr<T> acquire()
+        {
+            for (auto &item : items)
+            {
+                if (item.use_count() == 1)
+                {
+                    // The last user released the object after it was done with it
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    return item;
+                }
+            }
+            return std::make_shared<T>();
+        }
+};
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the append-only archive holding the images of the objects in a few large files
+ */
+
+# pragma once
+# include <atomic>
+# include <cstdint>
+# include <cstdio>
+# include <mutex>
+# include <string>
+# include <vector>
+
+/**
+ * @brief Defects of an archived object, combined as bits
+ */
+enum CropDefect : uint8_t
+{
+    CROP_ORIENTATION = 1,
+    CROP_COLOR = 2,
+    CROP_CRACK = 4
+};
+
+/**
+ * @brief Encoding of the data of an archived image
+ */
+enum CropEncoding : uint8_t
+{
+    CROP_PNG = 0,
+    CROP_JPEG = 1,
+    CROP_RAW = 2    // Pixels of the image, row after row, without any header
+};
+
+/**
+ * @brief Entry of the index of a segment, one per archived image
+ */
+struct CropIndexEntry
+{
+    uint64_t offset = 0;      // Position of the data in the data file of the segment
+    uint32_t size = 0;        // Length of the data in bytes
+    int32_t number = 0;       // Number of the object
+    int64_t timestamp = 0;    // Time the image was queued, nanoseconds since the epoch
+    uint16_t cols = 0;        // Size of the image in pixels
+    uint16_t rows = 0;
+    float length = 0;         // Length of the object in millimeters
+    float width = 0;          // Width of the object in millimeters
+    uint8_t category = 0;     // Index in crop_categories
+    uint8_t defects = 0;      // CropDefect bits
+    uint8_t encoding = CROP_PNG;
+    uint8_t channels = 0;
+    uint16_t stream = 0;      // Index of the name of the stream in the streams file of the archive
+    uint16_t reserved16 = 0;
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(CropIndexEntry) == 48, "The index entries are stored as they are in memory");
+
+/**
+ * @brief Names of the categories of the images, the folders they are saved in without an archive
+ */
+extern const char *const crop_categories[4];
+
+/**
+ * @brief Index of a category in crop_categories, the last one for an unknown name
+ */
+uint8_t crop_category(const std::string &name);
+
+/**
+ * @brief Writes images to an archive made of segments. Segment N is the data file <prefix>-N.dat holding the
+ * images back to back, and the index file <prefix>-N.idx holding one CropIndexEntry per image.
+ * Saving an image is one buffered append to each file, a new segment is started once the data file is full.
+ * The names of the streams are listed in <prefix>.streams, one per line.
+ * The archive is emptied when it is opened, as the folders of the images are.
+ */
+class CropArchive
+{
+    private:
+        std::string prefix;
+        size_t segment_bytes;
+        int segment = -1;
+        FILE *data_file = nullptr;
+        FILE *index_file = nullptr;
+        uint64_t data_offset = 0;
+        std::mutex lock;
+        std::vector<std::string> streams;
+        std::atomic<long> appended;
+
+        bool open_segment(int number);
+        void close_segment();
+
+    public:
+
+        /**
+         * @brief Constructor, removes the segments of a previous run and opens the first one
+         * @param prefix - Path of the segments without their number and extension
+         * @param segment_bytes - Size of the data file after which a new segment is started
+         */
+        CropArchive(const std::string &prefix, size_t segment_bytes);
+
+        CropArchive(const CropArchive&) = delete;
+        CropArchive& operator=(const CropArchive&) = delete;
+
+        ~CropArchive();
+
+        /**
+         * @brief True if the current segment could be opened
+         */
+        bool is_open() const { return data_file != nullptr; }
+
+        /**
+         * @brief Append an image. Safe to call from several threads
+         * @param entry - Description of the image, its offset and size are filled in
+         * @param data - Encoded image
+         * @param size - Length of the encoded image in bytes
+         * @return false if the image could not be written
+         */
+        bool append(CropIndexEntry entry, const void *data, size_t size);
+
+        /**
+         * @brief Index of a stream in the streams file of the archive, the name is added to it the first time
+         * @param name - Name of the stream
+         */
+        uint16_t stream_id(const std::string &name);
+
+        /**
+         * @brief Path of the file listing the names of the streams
+         */
+        static std::string streams_path(const std::string &prefix) { return prefix + ".streams"; }
+
+        /**
+         * @brief Hand the buffered images to the operating system, so that readers can see them
+         */
+        void flush();
+
+        /**
+         * @brief Flush and close the current segment
+         */
+        void close();
+
+        /**
+         * @brief Path of the data file of a segment
+         */
+        static std::string data_path(const std::string &prefix, int segment);
+
+        /**
+         * @brief Path of the index file of a segment
+         */
+        static std::string index_path(const std::string &prefix, int segment);
+
+        /**
+         * @brief Number of images appended
+         */
+        long appended_images() const { return appended; }
+};
+
+/**
+ * @brief Maps the segments of an archive in memory to list and extract the images without copying them
+ */
+class CropArchiveReader
+{
+    public:
+
+        /**
+         * @brief Archived image
+         */
+        struct Crop
+        {
+            const CropIndexEntry *entry;
+            const uint8_t *data;
+            int segment;
+        };
+
+    private:
+        struct Mapping
+        {
+            void *address;
+            size_t size;
+        };
+
+        std::vector<Mapping> mappings;
+        std::vector<Crop> crops;
+        std::vector<std::string> streams;
+
+        const uint8_t *map(const std::string &path, size_t &size);
+
+    public:
+
+        CropArchiveReader() = default;
+        CropArchiveReader(const CropArchiveReader&) = delete;
+        CropArchiveReader& operator=(const CropArchiveReader&) = delete;
+
+        ~CropArchiveReader();
+
+        /**
+         * @brief Map all the segments of an archive. Index entries pointing past the end of the data,
+         * like the last ones of an archive still being written, are left out
+         * @param prefix - Path of the segments without their number and extension
+         * @return false if the first segment could not be opened
+         */
+        bool open(const std::string &prefix);
+
+        /**
+         * @brief Images of the archive, in the order they were appended
+         */
+        const std::vector<Crop>& images() const { return crops; }
+
+        /**
+         * @brief Name of the stream an image comes from
+         * @param id - Index of the stream in the entry of the image
+         */
+        std::string stream_name(uint16_t id) const { return id < streams.size() ? streams[id] : std::to_string(id); }
+};
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the cascade running the defect detectors one after another, up to the first defect found
+ */
+
+# pragma once
+# include <cstdint>
+# include <string>
+# include <vector>
+
+#define CASCADE_MIN_RUNS 10   // Runs every detector needs before the cascade reorders them on its measurements
+#define CASCADE_MIN_GAIN 0.05 // Fraction of the expected time of the detectors a new order has to save to be taken
+
+/**
+ * @brief Defect detectors run on every object
+ */
+enum Detector
+{
+    DETECTOR_ORIENTATION,
+    DETECTOR_COLOR,
+    DETECTOR_CRACK,
+    DETECTOR_COUNT
+};
+
+/**
+ * @brief Name of a detector, as used in the config file and in the folders of the images
+ */
+const char *detector_name(Detector detector);
+
+/**
+ * @brief Detector from its name
+ * @return DETECTOR_COUNT if the name is unknown
+ */
+Detector parse_detector(const std::string &name);
+
+/**
+ * @brief Settings of the cascade
+ */
+struct CascadeConfig
+{
+    bool enabled = false;      // Run the detectors one after another and stop at the first defect, instead of all of them
+    std::vector<std::string> order = {"color", "orientation", "crack"};  // Order of the detectors until the first reorder
+    bool adaptive = true;      // Reorder the detectors by their measured cost and hit rate
+    int audit_every = 50;      // Run all the detectors on every Nth object anyway, 0 for never
+};
+
+/**
+ * @brief Measured runs of one detector
+ */
+struct DetectorStats
+{
+    uint64_t runs = 0;
+    uint64_t hits = 0;         // Runs which found a defect
+    uint64_t total_ns = 0;
+
+    /**
+     * @brief Average time of a run in nanoseconds
+     */
+    double mean_ns() const { return runs > 0 ? double(total_ns) / runs : 0; }
+
+    /**
+     * @brief Fraction of the runs which found a defect, smoothed so that it is never 0 or 1
+     */
+    double hit_rate() const { return (hits + 1.0) / (runs + 2.0); }
+};
+
+/**
+ * @brief Order in which the detectors of a pipeline run when only "defective or not" is needed.
+ * The expected time to the first defect is shortest with the detectors sorted by their cost divided by their hit rate,
+ * so the cheap detectors which often find a defect go first. The cascade measures both for every detector and,
+ * when adaptive, reorders them after each object. Not thread safe, it is used by the analysis stage of one pipeline
+ */
+class DetectorCascade
+{
+    private:
+        CascadeConfig config;
+        std::vector<Detector> current;
+        DetectorStats stats[DETECTOR_COUNT];
+        unsigned ran = 0;          // Detectors which ran on the current object, one bit each
+        long object_count = 0;
+        long audit_count = 0;
+        long stopped_count = 0;
+        long reorder_count = 0;
+        double saved = 0;
+
+    public:
+
+        /**
+         * @brief Constructor, the detectors missing from the configured order are added at its end
+         * @param config - Settings of the cascade
+         */
+        explicit DetectorCascade(const CascadeConfig &config);
+
+        /**
+         * @brief True if the detectors run in a cascade
+         */
+        bool enabled() const { return config.enabled; }
+
+        /**
+         * @brief True if all the detectors have to run on the next object, for an audit
+         */
+        bool auditNext() const;
+
+        /**
+         * @brief Current order of the detectors
+         */
+        const std::vector<Detector> &order() const { return current; }
+
+        /**
+         * @brief Add a run of a detector on the current object
+         * @param detector - Detector which ran
+         * @param ns - Time it took in nanoseconds
+         * @param defect - True if it found a defect
+         */
+        void record(Detector detector, uint64_t ns, bool defect);
+
+        /**
+         * @brief Close the current object: count the time saved on the detectors which did not run and reorder the detectors
+         * @param audit - True if all the detectors were run on the object
+         * @return true if the order changed
+         */
+        bool finishObject(bool audit);
+
+        /**
+         * @brief Measured runs of a detector
+         */
+        const DetectorStats &detector_stats(Detector detector) const { return stats[detector]; }
+
+        /**
+         * @brief Order of the detectors as text, "color, orientation, crack"
+         */
+        std::string order_text() const;
+
+        /**
+         * @brief Number of objects inspected, audited and stopped at a defect before all the detectors ran
+         */
+        long objects() const { return object_count; }
+        long audited() const { return audit_count; }
+        long stopped_early() const { return stopped_count; }
+
+        /**
+         * @brief Number of times the detectors were reordered
+         */
+        long reorders() const { return reorder_count; }
+
+        /**
+         * @brief Detector time saved in milliseconds, estimated from the average time of the detectors which did not run
+         */
+        double saved_ms() const { return saved / 1e6; }
+};
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the pool of threads encoding and saving the images of the objects
+ */
+
+# pragma once
+# include <atomic>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+# include <opencv2/core/core.hpp>
+# include "bounded_queue.h"
+# include "crop_archive.h"
+
+/**
+ * @brief Encoding of the saved images
+ */
+enum class ImageFormat
+{
+    Png,   // Lossless, compressed with the configured level
+    Jpeg,  // Lossy, encoded with the configured quality
+    Raw    // Uncompressed binary PPM, the cheapest to write
+};
+
+/**
+ * @brief Parse the name of an image format, "png", "jpg" or "raw". Unknown names give PNG
+ */
+ImageFormat parse_image_format(const std::string &name);
+
+/**
+ * @brief Settings of the image writer
+ */
+struct ImageWriterConfig
+{
+    size_t threads = 2;                      // Threads encoding and writing the images
+    size_t queue_size = 64;                  // Largest number of images waiting to be saved
+    ImageFormat format = ImageFormat::Png;
+    int png_compression = 1;                 // 0 (none) to 9 (smallest files, slowest)
+    int jpeg_quality = 90;                   // 0 to 100
+    std::map<std::string, int> save_every;   // Save only 1 in N images of a category, all of them when it is not listed
+    std::string archive;                     // Append the images to this archive instead of one file each, disabled when empty
+    size_t archive_segment_mb = 1024;        // Size of a segment of the archive in megabytes
+};
+
+/**
+ * @brief Saves the images of the objects from a pool of background threads.
+ * The caller only hands over a reference counted Mat, which must not be written to afterwards.
+ * The images are saved one file each, or appended to a CropArchive when one is configured.
+ * When the queue is full the image is dropped instead of holding up the inspection.
+ */
+class ImageWriter
+{
+    private:
+        struct Job
+        {
+            std::string path;        // File of the image, empty when it goes to the archive
+            CropIndexEntry entry;
+            cv::Mat image;
+        };
+
+        ImageWriterConfig config;
+        std::string extension;
+        std::vector<int> params;
+        std::unique_ptr<CropArchive> archive;
+        BoundedQueue<Job> jobs;
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::map<std::string, long> seen;   // Number of images offered per category, for the sampling
+        std::atomic<long> saved;
+        std::atomic<long> dropped;
+        std::atomic<long> skipped;
+        std::atomic<long> failed;
+
+        void run();
+
+    public:
+
+        /**
+         * @brief Constructor, starts the worker threads
+         * @param config - Settings of the writer
+         */
+        explicit ImageWriter(const ImageWriterConfig &config);
+
+        ImageWriter(const ImageWriter&) = delete;
+        ImageWriter& operator=(const ImageWriter&) = delete;
+
+        ~ImageWriter();
+
+        /**
+         * @brief Queue an image to be saved as <category>/object_<number>.<extension>,
+         * or <category>/<stream>_object_<number>.<extension> for a named stream
+         * @param category - Directory of the image, also the key of its sampling rate
+         * @param stream - Name of the stream the image comes from, empty when there is only one
+         * @param number - Number of the object
+         * @param image - Image to be saved, shared with the caller and not copied
+         * @param defects - CropDefect bits of the object, kept in the index of the archive
+         * @param length - Length of the object in millimeters, kept in the index of the archive
+         * @param width - Width of the object in millimeters, kept in the index of the archive
+         * @return true if the image was queued, false if it was sampled out or dropped
+         */
+        bool save(const std::string &category, const std::string &stream, int number, const cv::Mat &image, uint8_t defects = 0, float length = 0, float width = 0);
+
+        /**
+         * @brief Save the queued images and stop the worker threads
+         */
+        void close();
+
+        /**
+         * @brief Number of images written to the disk
+         */
+        long saved_images() const { return saved; }
+
+        /**
+         * @brief Number of images dropped because the queue was full
+         */
+        long dropped_images() const { return dropped; }
+
+        /**
+         * @brief Number of images left out by the sampling rate of their category
+         */
+        long skipped_images() const { return skipped; }
+
+        /**
+         * @brief Number of images which could not be written
+         */
+        long failed_images() const { return failed; }
+};
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the disk spool keeping the batches InfluxDB could not accept
+ */
+
+# pragma once
+# include <atomic>
+# include <chrono>
+# include <condition_variable>
+# include <cstdint>
+# include <functional>
+# include <mutex>
+# include <string>
+# include <thread>
+
+namespace influx
+{
+
+    /**
+     * @brief Settings of the spool
+     */
+    struct SpoolConfig
+    {
+        std::string path;                      // Spool file, the replay position is kept next to it in <path>.offset
+        size_t max_bytes = 256 * 1024 * 1024;  // Largest size of the spool file, batches which do not fit are dropped
+        int retry_interval_ms = 5000;          // Time between two attempts to reach the database again
+        int sync_interval_ms = 1000;           // Time between two flushes of the spool file to the disk
+    };
+
+    /**
+     * @brief Append-only file of the batches of points which could not be written to the database.
+     * Each batch is stored as a record with its length and CRC, and the records are flushed to the disk together
+     * at most once per sync interval. A background thread replays the records in order once the database answers again,
+     * and empties the file when all of them have been sent. On startup, a record which was only partially written
+     * is cut off and the replay resumes from the saved position.
+     */
+    class Spool
+    {
+        private:
+            SpoolConfig config;
+            int fd = -1;
+            int offset_fd = -1;
+            uint64_t read_offset = 0;    // Start of the next record to replay
+            uint64_t end_offset = 0;     // End of the last record
+            bool dirty = false;
+            bool stopping = false;
+            std::chrono::steady_clock::time_point next_retry;
+            std::function<int(const std::string&)> sender;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::thread worker;
+            std::atomic<long> queued;
+            std::atomic<long> replayed;
+            std::atomic<long> dropped;
+
+            void recover();
+            void sync();
+            void save_offset();
+            bool read_record(uint64_t offset, std::string& payload, uint32_t& count, uint64_t& next);
+            uint64_t find_record(uint64_t offset, uint64_t end);
+            void run();
+
+        public:
+
+            /**
+             * @brief Open the spool file and recover its content
+             * @param config - Settings of the spool
+             */
+            explicit Spool(const SpoolConfig& config);
+
+            Spool(const Spool&) = delete;
+            Spool& operator=(const Spool&) = delete;
+
+            /**
+             * @brief Stop the replay and flush the spool file
+             */
+            ~Spool();
+
+            /**
+             * @brief True if the spool file could be opened
+             */
+            bool is_open() const { return fd >= 0; }
+
+            /**
+             * @brief Start replaying the records in the background
+             * @param send - Sends one batch to the database, returns -1 in case of error else 0
+             */
+            void start(std::function<int(const std::string&)> send);
+
+            /**
+             * @brief Stop the replay thread and flush the spool file. The records not replayed are kept for the next run
+             */
+            void stop();
+
+            /**
+             * @brief Append a batch to the spool file. Does not wait for the disk
+             * @param lines - Points in line protocol separated by new lines
+             * @param count - Number of points in the batch
+             * @return false if the batch did not fit in the spool and was dropped
+             */
+            bool append(const std::string& lines, size_t count);
+
+            /**
+             * @brief True if some records are waiting to be replayed
+             */
+            bool pending();
+
+            /**
+             * @brief Number of points waiting in the spool
+             */
+            long pending_points() const { return queued; }
+
+            /**
+             * @brief Number of points replayed to the database
+             */
+            long replayed_points() const { return replayed; }
+
+            /**
+             * @brief Number of points dropped because the spool was full or their record was damaged
+             */
+            long dropped_points() const { return dropped; }
+    };
+};
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the asynchronous writer sending batches of points to InfluxDB
+ */
+
+# pragma once
+# include <atomic>
+# include <condition_variable>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include "influx_spool.h"
+# include "influxdb.h"
+# include "line_protocol.h"
+
+namespace influx
+{
+
+    /**
+     * @brief What to do with a new point when the queue of the writer is full
+     */
+    enum class DropPolicy
+    {
+        DropOldest,  // Discard the oldest queued point to make room
+        DropNewest,  // Discard the new point
+        Block        // Wait for room in the queue
+    };
+
+    /**
+     * @brief Settings of the asynchronous writer
+     */
+    struct WriterConfig
+    {
+        size_t batch_size = 100;                         // A batch is sent as soon as this many points are queued
+        int flush_interval_ms = 1000;                    // Longest time a point waits in the queue
+        size_t queue_size = 10000;                       // Largest number of points held in the queue
+        bool gzip = false;                               // Send the batches gzip compressed
+        DropPolicy drop_policy = DropPolicy::DropOldest;
+        SpoolConfig spool;                               // Disk spool for the batches which fail, disabled when its path is empty
+    };
+
+    /**
+     * @brief Buffers points in a bounded queue and writes them in batches from a background thread,
+     * so that a slow database does not slow down the caller.
+     * The queued points are appended to one text buffer which is sent as the body of the next request.
+     * When a spool is configured, the batches the database does not accept are kept on disk and replayed later.
+     * While the spool is not empty the new batches go to it as well, so that the points reach the database in order.
+     */
+    class AsyncWriter
+    {
+        private:
+            InfluxDB& db;
+            std::string db_name;
+            WriterConfig config;
+            std::string pending;   // Queued points in line protocol, separated by new lines
+            std::string sending;   // Batch being sent, swapped with pending to reuse both buffers
+            std::string chunk;     // Part of the batch sent in one request
+            size_t pending_count = 0;
+            size_t pending_start = 0;  // Offset of the oldest queued point in pending, the points before it were dropped
+            bool closing = false;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::condition_variable not_full;
+            std::thread worker;
+            std::atomic<long> dropped;
+            std::atomic<long> written;
+            std::atomic<long> failed;
+            std::atomic<long> batches;
+            std::atomic<long> spooled;
+            std::unique_ptr<Spool> spool;
+
+            void run();
+            int send(const std::string& lines);
+            void deliver(const std::string& lines, size_t count);
+            bool make_room(std::unique_lock<std::mutex>& guard, size_t count);
+
+        public:
+
+            /**
+             * @brief Constructor, starts the background thread
+             * @param db - Client used to send the batches
+             * @param db_name - Name of the database in which data has to written
+             * @param config - Settings of the writer
+             */
+            AsyncWriter(InfluxDB& db, const std::string& db_name, const WriterConfig& config);
+
+            AsyncWriter(const AsyncWriter&) = delete;
+            AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+            /**
+             * @brief Send the points still queued and stop the background thread
+             */
+            ~AsyncWriter();
+
+            /**
+             * @brief Queue a point. Points without a timestamp get the current time in nanoseconds
+             * @param data - Point to be written
+             * @return false if the point was dropped
+             */
+            bool write(Data& data);
+
+            /**
+             * @brief Queue the points of a builder, which should carry their timestamps
+             * @param points - Points to be written
+             * @return false if the points were dropped
+             */
+            bool write(const LineBuilder& points);
+
+            /**
+             * @brief Send the points still queued and stop the background thread. Called by the destructor
+             */
+            void close();
+
+            /**
+             * @brief Number of points waiting in the queue
+             */
+            size_t depth();
+
+            /**
+             * @brief Number of points dropped because the queue was full
+             */
+            long dropped_points() const { return dropped; }
+
+            /**
+             * @brief Number of points written to the database
+             */
+            long written_points() const { return written; }
+
+            /**
+             * @brief Number of points in the batches the database did not accept and the spool could not keep
+             */
+            long failed_points() const { return failed; }
+
+            /**
+             * @brief Number of batches sent
+             */
+            long sent_batches() const { return batches; }
+
+            /**
+             * @brief Number of points handed to the spool
+             */
+            long spooled_points() const { return spooled; }
+
+            /**
+             * @brief Disk spool of the writer, nullptr if there is none
+             */
+            const Spool* get_spool() const { return spool.get(); }
+    };
+
+    /**
+     * @brief Parse the name of a drop policy: "drop_oldest", "drop_newest" or "block"
+     */
+    DropPolicy parse_drop_policy(const std::string& name);
+};
@@ -28,8 +28,8 @@
 # pragma once
 # include <curl/curl.h>
 # include <iostream>
+# include <mutex>
 # include <vector>
-# include <regex>
 
 /**
  * @brief namespace for InfluxDB class and data structure
@@ -98,12 +98,17 @@ namespace influx
             
             void add_timestamp(long long _time);
 
+            /**
+             * @brief True if a timestamp has been added to the point
+             */
+            bool has_timestamp() const { return is_time; }
+
             /**
              * @brief Build the data string (data to be written to influxDB) that will be sent as data using InfluxDB Rest API
              * @return data string
              */
 
-            std::string build_query();
+            std::string build_query() const;
 
             /**
              * @brief Add an escape character '\' in case on " ", "," and "=" in string values of key
@@ -119,7 +124,10 @@ namespace influx
     } data;
 
     /**
-     * @brief InfluxDB class to manage and write the data to the database
+     * @brief InfluxDB class to manage and write the data to the database.
+     * One instance is meant to live for the whole process: it keeps a single curl handle,
+     * so the HTTP connection is kept alive and reused from one request to the next.
+     * The requests of several threads are serialized on the handle.
      */
     class InfluxDB
     {
@@ -127,7 +135,15 @@ namespace influx
             std::string host;
             int port;
             std::string url;
-            FILE* file = fopen("../influx-logs.txt", "w");
+            std::string write_db;
+            std::string write_url;
+            FILE* file = nullptr;
+            CURL* handle = nullptr;
+            struct curl_slist* gzip_headers = nullptr;
+            std::mutex lock;
+
+            void init();
+            CURLcode perform(const std::string& _url, const std::string& data, struct curl_slist* headers = nullptr);
 
         public:
 
@@ -144,6 +160,14 @@ namespace influx
 
             InfluxDB(std::string host, int port);
 
+            InfluxDB(const InfluxDB&) = delete;
+            InfluxDB& operator=(const InfluxDB&) = delete;
+
+            /**
+             * @brief Release the curl handle and close the log file
+             */
+            ~InfluxDB();
+
             /**
              * @brief Post the query using InfluxDB Rest API
              * @param _url - url on which request has to be posted
@@ -151,7 +175,7 @@ namespace influx
              * @return - Request status
              */
             
-            CURLcode http_post(std::string _url, std::string data);
+            CURLcode http_post(const std::string& _url, const std::string& data);
 
             /**
              * @brief Creates the database in InfluxDB
@@ -167,6 +191,15 @@ namespace influx
              * @param data - Data to be written to the database
              * @return -1 in case of error else 0
              */            
-            int write_point(std::string db_name, influx::Data data); 
+            int write_point(const std::string& db_name, const influx::Data& data); 
+
+            /**
+             * @brief Write points already in line protocol to the database
+             * @param db_name - Name of the database in which data has to written
+             * @param lines - Points separated by new lines
+             * @param gzip - True if lines holds a gzip compressed body
+             * @return -1 in case of error else 0
+             */
+            int write_lines(const std::string& db_name, const std::string& lines, bool gzip = false);
     };
 };
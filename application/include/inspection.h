@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the segmentation, measurement and defect detection of the objects
+ */
+
+# pragma once
+# include <cstdint>
+# include <memory>
+# include <string>
+# include <vector>
+# include <opencv2/core/core.hpp>
+
+#define OBJECT_AREA_MIN 9000
+#define OBJECT_AREA_MAX 50000
+#define MAX_DEFECT_TYPES 3
+
+// Masked crack detection
+#define CRACK_TILE_SIZE 32        // Side in pixels of the tiles the object is split into
+#define CRACK_MASK_EROSION 4      // Pixels removed from the mask of the object, so that its outline is not taken for a crack
+#define CRACK_TILE_MIN_EDGES 8    // Edge pixels, about the length of the edges, a tile must hold to be traced
+#define CRACK_TILE_MIN_DENSITY 0.01
+#define CRACK_MIN_LENGTH 15       // Pixels a traced edge must span to be a crack
+
+// Color defect detection: brightness added to the object, and HSV range of the colors taken for a defect
+#define COLOR_BRIGHTNESS 20
+#define COLOR_LOW_H 0
+#define COLOR_LOW_S 0
+#define COLOR_LOW_V 0
+#define COLOR_HIGH_H 174
+#define COLOR_HIGH_S 73
+#define COLOR_HIGH_V 255
+
+// Lower and Upper value of color range of the object
+#define LOW_H 0
+#define LOW_S 0
+#define LOW_V 47
+#define HIGH_H 179
+#define HIGH_S 255
+#define HIGH_V 255
+
+/**
+ * @brief Object found on a frame, to be checked for defects
+ */
+struct ObjectSample
+{
+    int number = 0;                                                 // Object number
+    int track_id = 0;                                               // Id of the track of the object, 0 when not tracked
+    long frame_index = 0;                                           // Index of the frame in the stream
+    cv::Mat frame;                                                  // Frame on which the object was found
+    cv::Rect object;                                                // Bounding rect of the object
+    cv::Rect roi;                                                   // Region of the frame handed to the detectors
+    std::shared_ptr<std::vector<std::vector<cv::Point>>> contours;  // Contours found on the frame
+    size_t contour_index = 0;                                       // Index of the contour of the object
+    cv::Vec2f measurement;                                          // Length and width of the object in millimeters
+};
+
+/**
+ * @brief Classifies BGR pixels in a single lookup each, with one bit per BGR color (2 MB). The table is built by running
+ * the brightening, the HSV conversion and the range test once over all the colors, so the masks it gives are exactly
+ * those of the three passes it replaces. The pass is scalar: a lookup per pixel does not vectorize without a gather
+ * instruction, and it is still cheaper than the three vectorized passes
+ */
+class ColorTable
+{
+    public:
+        /**
+         * @param brightness - Value added to every channel before the conversion, saturating
+         * @param lower - Lower bound of the HSV range, inclusive
+         * @param upper - Upper bound of the HSV range, inclusive
+         */
+        ColorTable(double brightness, cv::Scalar lower, cv::Scalar upper);
+
+        /**
+         * @brief Set the pixels of the mask to 255 where the color of the frame is in the range and to 0 elsewhere
+         * @param frame - BGR frame, 8 bits per channel, can be a view
+         * @param mask - Receives the mask, same size as the frame
+         */
+        void classify(const cv::Mat &frame, cv::Mat &mask) const;
+
+        /**
+         * @brief Table of the color defect detection, built on the first call
+         */
+        static const ColorTable &colorDefects();
+
+    private:
+        std::vector<uint64_t> bits;  // Bit (b << 16 | g << 8 | r) is set when the color is in the range
+};
+
+/**
+ * @brief Outcome of one defect detector
+ */
+struct DefectResult
+{
+    bool defect = false;  // True if the defect is present in the object
+    cv::Mat image;        // Image given to the detector with the defect marked on it, only set when the defect is present
+};
+
+/**
+ * @brief Main axis of an object
+ */
+struct ObjectOrientation
+{
+    double angle = 0;         // Angle of the main axis in radians, in (-pi/4, 3pi/4] like the PCA gives it
+    double eccentricity = 0;  // 0 for a round object, close to 1 for a long and thin one
+    double confidence = 0;    // (major - minor) / (major + minor) of the variances along the axes, 0 when the angle means nothing
+};
+
+/**
+ * @brief Outcome of all the defect detectors for one object
+ */
+struct InspectionResult
+{
+    ObjectSample sample;
+    ObjectOrientation axis;   // Main axis of the object, only set when its contour is large enough to be measured
+    bool complete = true;     // False when the detector cascade stopped at a defect, the detectors after it did not run
+    DefectResult orientation;
+    DefectResult color;
+    DefectResult crack;
+};
+
+/**
+ * @brief Find the contours of the blobs of a mask, skipping the small ones without tracing them.
+ * The mask is split into runs of pixels which are linked into blobs, 8-connected like findContours sees them,
+ * and only the blobs whose bounding rect is larger than the limit are traced. The contours are those findContours
+ * gives with RETR_LIST and CHAIN_APPROX_NONE, in the same order, less the ones of the skipped blobs.
+ * Contours starting on the same point are ordered outer contour first.
+ * The holes of the traced blobs are all kept, whatever their size
+ * @param mask - Binary mask of type CV_8UC1
+ * @param min_box_area - Blobs whose bounding rect has this area in pixels or less are skipped
+ * @param contours - Receives the contours
+ */
+void findBlobContours(const cv::Mat &mask, int min_box_area, std::vector<std::vector<cv::Point>> &contours);
+
+/**
+ * @brief Find the contours of the objects on the frame
+ * @param frame - BGR frame
+ * @param contours - Receives the contours found on the thresholded frame
+ * @param min_box_area - When positive, the blobs whose bounding rect has this area or less are dropped before
+ * their contours are traced, so that the time taken does not grow with the specks on the belt
+ */
+void findObjects(const cv::Mat &frame, std::vector<std::vector<cv::Point>> &contours, int min_box_area = 0);
+
+/**
+ * @brief Find the contours of the objects coarse to fine: the objects are first found on the frame downscaled by a factor,
+ * with the lower area limit scaled down with it, and then segmented again at full resolution only around each of them.
+ * Most of the cost then falls with the square of the factor
+ * @param frame - BGR frame
+ * @param scale - Downscaling factor of the first pass, 2 or 4. The frame is segmented at full resolution when 1 or less
+ * @param contours - Receives the full resolution contour of every object found on the downscaled frame, once each, including
+ * the objects close enough to be merged by the downscaling. Only the contours whose bounding rect is within the area limits
+ * of an object are given when the factor is above 1. At full resolution, the contours of the blobs too small to be an
+ * object are left out
+ * @param prefilter - Skip the blobs too small to be an object before tracing their contours. When false,
+ * every contour of the frame is traced with findContours
+ */
+void locateObjects(const cv::Mat &frame, int scale, std::vector<std::vector<cv::Point>> &contours, bool prefilter = true);
+
+/**
+ * @brief Create dataset for PCA Analysis
+ * @param contour_points - Points of the contour
+ * @return Matrix with one point per row
+ */
+cv::Mat createBuffer(const std::vector<cv::Point> &contour_points);
+
+/**
+ * @brief Create dataset for PCA Analysis into a matrix that is reused from call to call
+ * @param contour_points - Points of the contour
+ * @param data_points - Receives one point per row, only reallocated when it has to grow
+ */
+void createBuffer(const std::vector<cv::Point> &contour_points, cv::Mat &data_points);
+
+/**
+ * @brief Get the orientation of the object
+ * @param data_points - Points of the contour, one per row
+ * @return Angle of the main axis in radians
+ */
+double getOrientation(cv::Mat data_points);
+
+/**
+ * @brief Get the main axis from second order central moments, in closed form. Only their ratios matter,
+ * so they can be scaled by any positive factor
+ * @param mu20 - Moment along x
+ * @param mu11 - Mixed moment
+ * @param mu02 - Moment along y
+ */
+ObjectOrientation orientationFromMoments(double mu20, double mu11, double mu02);
+
+/**
+ * @brief Get the orientation of the object from the second order central moments of its contour points.
+ * The angle is the one of the PCA of the same points, with the same sign convention,
+ * for a single pass over the points and no allocation
+ * @param contour_points - Points of the contour
+ */
+ObjectOrientation contourOrientation(const std::vector<cv::Point> &contour_points);
+
+/*
+ * The detectors only read the frame and keep no state between calls,
+ * so the three of them can run concurrently on the same object.
+ * They can be given either the whole frame or a view of the region around the object.
+ */
+
+/**
+ * @brief Detect orientation defect of the object
+ * @param frame - Frame on which the object was found
+ * @param contour - Contour of the object
+ * @param object - Bounding rect of the object
+ * @param axis - Receives the main axis of the object when not null
+ */
+DefectResult detectOrientation(const cv::Mat &frame, const std::vector<cv::Point> &contour, cv::Rect object, ObjectOrientation *axis = nullptr);
+
+/**
+ * @brief Detect color defect of the object
+ * @param frame - Frame on which the object was found
+ * @param object - Bounding rect of the object
+ * @param prefilter - Skip the blobs too small to be a defect before tracing their contours
+ */
+DefectResult detectColor(const cv::Mat &frame, cv::Rect object, bool prefilter = true);
+
+/**
+ * @brief Detect crack defect of the object
+ * @param frame - Frame on which the object was found
+ * @param object - Bounding rect of the object
+ */
+DefectResult detectCrack(const cv::Mat &frame, cv::Rect object);
+
+/**
+ * @brief Detect crack defect of the object, only looking inside the object.
+ * The mask of the object, eroded to drop its outline, is split into tiles which are processed in parallel.
+ * Every tile scores its edges inside the mask by their density and their length in pixels,
+ * and only the edges of the tiles scoring high enough are traced
+ * @param frame - Frame on which the object was found
+ * @param contour - Contour of the object
+ * @param object - Bounding rect of the object
+ * @param contour_offset - Offset moving the contour to the coordinates of the frame, when the frame is a view of a region
+ */
+DefectResult detectCrackInMask(const cv::Mat &frame, const std::vector<cv::Point> &contour, cv::Rect object,
+                               cv::Point contour_offset = cv::Point());
+
+/**
+ * @brief Calculate euclidean distance between two points
+ */
+double calculate_distance(cv::Point pts1, cv::Point pts2);
+
+/**
+ * @brief Returns the value rounded to the given decimal place
+ */
+double round(double value, int place);
+
+/**
+ * @brief Return the Length and Width of the object
+ * @param pts - Corners of the minimum area rect of the object
+ * @param one_pixel_length - Length of one pixel in centimeters
+ * @return Length and width in millimeters, longest first
+ */
+cv::Vec2f find_dimensions(const std::vector<cv::Point> &pts, float one_pixel_length);
+
+/**
+ * @brief Return the Length and Width of the object from its contour
+ * @param contour - Contour of the object
+ * @param one_pixel_length - Length of one pixel in centimeters
+ */
+cv::Vec2f measureObject(const std::vector<cv::Point> &contour, float one_pixel_length);
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the builder formatting points in the InfluxDB line protocol without allocating
+ */
+
+# pragma once
+# include <string>
+
+namespace influx
+{
+
+    /**
+     * @brief Current time in nanoseconds since the epoch, the precision of the line protocol timestamps
+     */
+    long long now_ns();
+
+    /**
+     * @brief Escape the characters of a key or tag value in one scan: ',', ' ' and '=', and only ',' and ' ' for a measurement.
+     * Reference - InfluxDB write protocol
+     * @param out - String the escaped text is appended to
+     * @param data - Text to be escaped
+     * @param size - Length of the text
+     * @param measure - True if it is a measurement name
+     */
+    void append_escaped(std::string& out, const char* data, size_t size, bool measure);
+
+    /**
+     * @brief Writes points in line protocol into one reusable buffer.
+     * The buffer is reserved up front and clear() keeps its capacity, numbers are formatted in place,
+     * so in steady state building a point does not allocate. Several points can be built one after the other
+     * to make a batch. The output is the same as the one of Data::build_query().
+     *
+     * Usage: builder.measure("Defect").tag("line", "1").field("objectNumber", 12).timestamp(now_ns());
+     */
+    class LineBuilder
+    {
+        private:
+            std::string buffer;
+            size_t lines = 0;
+            bool in_fields = false;
+
+            void append_int(long long value);
+            void begin_field(const char* key);
+
+        public:
+
+            /**
+             * @brief Constructor
+             * @param capacity - Bytes reserved for the buffer
+             */
+            explicit LineBuilder(size_t capacity = 4096);
+
+            /**
+             * @brief Start a new point
+             * @param name - Name of the measurement
+             */
+            LineBuilder& measure(const char* name);
+
+            /**
+             * @brief Add a tag, tags must come before the fields
+             * @param key - Tag Key
+             * @param value - Tag value
+             */
+            LineBuilder& tag(const char* key, const char* value);
+
+            LineBuilder& tag(const char* key, const std::string& value);
+
+            LineBuilder& tag(const char* key, long long value);
+
+            /**
+             * @brief Add a field
+             * @param key - field Key
+             * @param value - field value
+             */
+            LineBuilder& field(const char* key, int value);
+
+            LineBuilder& field(const char* key, long value);
+
+            LineBuilder& field(const char* key, long long value);
+
+            LineBuilder& field(const char* key, double value);
+
+            LineBuilder& field(const char* key, const char* value);
+
+            LineBuilder& field(const char* key, const std::string& value);
+
+            /**
+             * @brief End the point with its timestamp
+             * @param time - Timestamp in nanoseconds
+             */
+            LineBuilder& timestamp(long long time);
+
+            /**
+             * @brief Remove all the points, the capacity of the buffer is kept
+             */
+            void clear();
+
+            /**
+             * @brief Points built so far, separated by new lines
+             */
+            const std::string& str() const { return buffer; }
+
+            /**
+             * @brief Number of points built so far
+             */
+            size_t count() const { return lines; }
+    };
+};
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the fused morphological opening and closing of binary masks
+ */
+
+# pragma once
+# include <opencv2/core/core.hpp>
+
+/**
+ * @brief 5x5 elliptical structuring element, built once and shared
+ */
+const cv::Mat &ellipseKernel();
+
+/**
+ * @brief Morphological opening followed by closing with the 5x5 ellipse, using the OpenCV erode and dilate.
+ * Kept as the reference the fused operator is checked against
+ * @param src - Binary mask
+ * @param dst - Filtered mask, can be the same as src
+ */
+void openCloseReference(const cv::Mat &src, cv::Mat &dst);
+
+/**
+ * @brief Morphological opening followed by closing with the 5x5 ellipse, in one pass over the mask.
+ * The mask is packed to one bit per pixel and the four erode/dilate steps run on strips of rows
+ * small enough to stay in the cache, 64 pixels at a time. The result is identical to openCloseReference()
+ * @param src - Binary mask of type CV_8UC1 holding 0 or 255
+ * @param dst - Filtered mask, can be the same as src
+ */
+void openClose(const cv::Mat &src, cv::Mat &dst);
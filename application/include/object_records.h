@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the records of the inspected objects written in replay mode, and their comparison with a golden file
+ */
+
+# pragma once
+# include <cstdio>
+# include <mutex>
+# include <string>
+# include <vector>
+# include <opencv2/core/core.hpp>
+# include "inspection.h"
+
+/**
+ * @brief Outcome of the inspection of one object
+ */
+struct ObjectRecord
+{
+    std::string stream;      // Name of the stream, empty when there is only one
+    int number = 0;          // Object number
+    long frame = 0;          // Index of the frame the object was inspected on
+    cv::Rect object;         // Bounding rect of the object
+    float length = 0;        // Length of the object in millimeters
+    float width = 0;         // Width of the object in millimeters
+    bool orientation = false;
+    bool color = false;
+    bool crack = false;
+    bool complete = true;    // False when the detector cascade skipped checks, whose defects are then unknown
+    double angle = 0;        // Angle of the main axis of the object in radians, informative only
+    double eccentricity = 0;
+};
+
+/**
+ * @brief Writes one record per inspected object, as CSV when the file name ends with .csv and as JSON lines otherwise.
+ * The records are also kept in memory, to be compared with a golden file at the end of the run
+ */
+class ObjectRecorder
+{
+    private:
+        FILE *file = nullptr;
+        bool csv = false;
+        std::mutex lock;
+        std::vector<ObjectRecord> recorded;
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param path - File the records are written to, the records are only kept in memory when empty
+         */
+        explicit ObjectRecorder(const std::string &path);
+
+        ObjectRecorder(const ObjectRecorder&) = delete;
+        ObjectRecorder& operator=(const ObjectRecorder&) = delete;
+
+        ~ObjectRecorder();
+
+        /**
+         * @brief Add the record of an inspected object. Safe to call from several threads
+         * @param stream - Name of the stream of the object
+         * @param result - Outcome of the detectors for the object
+         */
+        void record(const std::string &stream, const InspectionResult &result);
+
+        /**
+         * @brief Flush and close the file
+         */
+        void close();
+
+        /**
+         * @brief Records written so far
+         */
+        const std::vector<ObjectRecord>& records() const { return recorded; }
+};
+
+/**
+ * @brief Read the records of a file written by ObjectRecorder
+ * @param path - CSV or JSON lines file
+ * @param records - Receives the records
+ * @return false if the file could not be read
+ */
+bool loadRecords(const std::string &path, std::vector<ObjectRecord> &records);
+
+/**
+ * @brief Compare the records of a run with the golden ones and print the differences.
+ * Objects are matched by stream and number, their lengths may differ by 0.01 mm
+ * @return Number of objects which differ, are missing or were not expected
+ */
+int compareRecords(const std::vector<ObjectRecord> &golden, const std::vector<ObjectRecord> &records);
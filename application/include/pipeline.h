@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the multi-stage pipeline running capture, segmentation, defect analysis and output on separate threads
+ */
+
+# pragma once
+# include <atomic>
+# include <string>
+# include <thread>
+# include <vector>
+# include <opencv2/core/core.hpp>
+# include <opencv2/highgui/highgui.hpp>
+# include "bounded_queue.h"
+# include "detector_cascade.h"
+# include "image_writer.h"
+# include "influx_writer.h"
+# include "inspection.h"
+# include "object_records.h"
+# include "thread_pool.h"
+# include "tracker.h"
+
+/**
+ * @brief Settings of the pipeline
+ */
+struct PipelineConfig
+{
+    std::string stream;                    // Name of the stream, tags its points and images when several streams run
+    bool headless = false;                 // Skip all the GUI work and the display pacing
+    size_t queue_size = 8;                 // Capacity of the queues between the stages
+    int sample_interval = 40;              // Check every Nth frame (chosen based on the frequency of object on conveyor belt)
+    size_t analysis_threads = 0;           // Worker threads running the defect detectors, 0 for one per CPU core
+    bool roi_detection = false;            // Run the detectors on the region around the object instead of the whole frame
+    int roi_margin = 10;                   // Pixels added around the bounding rect of the object in ROI mode
+    int localization_scale = 1;            // Find the objects on the frame downscaled by this factor (2 or 4), then refine them at full resolution
+    bool blob_prefilter = true;            // Skip the blobs too small to be an object or a color defect before tracing their contours
+    bool masked_crack_detection = false;   // Look for cracks inside the object only, tile by tile, instead of on every edge of the frame
+    int display_interval = 1;              // Show every Nth frame of the stream, the frames neither shown nor analysed are never retrieved
+    TrackerConfig tracker;                 // Inspect every object once as it crosses a trigger line
+    CascadeConfig cascade;                 // Stop the detectors of an object at its first defect
+    float one_pixel_length = 0.0264583333; // Length of one pixel in centimeters
+};
+
+/**
+ * @brief Frame read from the stream
+ */
+struct Frame
+{
+    long index = 0;
+    cv::Mat image;
+};
+
+/**
+ * @brief Frame to be shown in the output window
+ */
+struct DisplayItem
+{
+    cv::Mat image;
+    int delay = 25;          // Time in milliseconds the frame is shown for
+    bool live = true;        // True for a frame of the stream, false for an inspected object
+    std::string count_text;  // Text of the inspected object, shown on the following live frames
+    std::string height_text;
+    std::string width_text;
+};
+
+/**
+ * @brief Pipeline of stages connected by bounded queues.
+ * Capture, segmentation, defect analysis and output each run on their own thread,
+ * a full queue blocks the upstream stage until the downstream one catches up.
+ */
+class Pipeline
+{
+    private:
+        cv::VideoCapture &capture;
+        PipelineConfig config;
+        ThreadPool &pool;
+        influx::AsyncWriter *writer;
+        ImageWriter &images;
+        ObjectRecorder *recorder;
+        BoundedQueue<Frame> frames;
+        BoundedQueue<ObjectSample> objects;
+        BoundedQueue<InspectionResult> results;
+        BoundedQueue<DisplayItem> display_items;
+        std::thread capture_thread;
+        std::thread segmentation_thread;
+        std::thread analysis_thread;
+        std::thread output_thread;
+        std::atomic<bool> stopped;
+        std::atomic<long> frame_count;
+        std::atomic<long> decoded_count;
+        std::atomic<long> skipped_count;
+        std::atomic<int> object_count;
+        DetectorCascade cascade;
+
+        void captureStage();
+        void segmentationStage();
+        void analysisStage();
+        void outputStage();
+        bool queueObjects(std::vector<ObjectSample> &samples);
+        DefectResult runDetector(Detector detector, const ObjectSample &sample, const cv::Mat &view, cv::Rect object,
+                                 ObjectOrientation &axis, uint64_t &ns) const;
+        void prepareDisplay(DisplayItem &item, DisplayItem &last);
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param capture - Opened stream to read the frames from
+         * @param config - Settings of the pipeline
+         * @param pool - Worker threads running the defect detectors
+         * @param writer - Writer sending the defects to InfluxDB in the background, nullptr to write nothing
+         * @param images - Writer saving the images of the objects in the background
+         * @param recorder - Receives the outcome of every inspected object, may be nullptr
+         */
+        Pipeline(cv::VideoCapture &capture, const PipelineConfig &config, ThreadPool &pool, influx::AsyncWriter *writer,
+                 ImageWriter &images, ObjectRecorder *recorder = nullptr);
+
+        ~Pipeline();
+
+        /**
+         * @brief Start the threads of all the stages
+         */
+        void start();
+
+        /**
+         * @brief Show the frames in the output window until the stream ends or q is pressed.
+         * Has to be called from the main thread, nothing is shown in headless mode
+         * @return false if the user quit before the stream ended
+         */
+        bool display();
+
+        /**
+         * @brief Show the frames of several pipelines, each in its own window, until all the streams end or q is pressed.
+         * Has to be called from the main thread, the pipelines in headless mode are skipped
+         * @param pipelines - Pipelines to be shown
+         * @return false if the user quit before the streams ended
+         */
+        static bool display(const std::vector<Pipeline*> &pipelines);
+
+        /**
+         * @brief Stop all the stages, the items still queued are dropped
+         */
+        void stop();
+
+        /**
+         * @brief Wait for all the stages to finish
+         */
+        void join();
+
+        /**
+         * @brief Number of frames read from the stream
+         */
+        long frames_read() const { return frame_count; }
+
+        /**
+         * @brief Number of frames retrieved, which decodes them to BGR, to be analysed or shown
+         */
+        long frames_decoded() const { return decoded_count; }
+
+        /**
+         * @brief Number of frames grabbed but never retrieved, as they were neither analysed nor shown
+         */
+        long frames_skipped() const { return skipped_count; }
+
+        /**
+         * @brief Number of objects inspected
+         */
+        int objects_found() const { return object_count; }
+
+        /**
+         * @brief Order, measurements and savings of the detector cascade, only to be read once the pipeline has finished
+         */
+        const DetectorCascade &detector_cascade() const { return cascade; }
+};
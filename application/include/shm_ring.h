@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the ring of frames in POSIX shared memory, filled by a grabber process and read by the application
+ */
+
+# pragma once
+# include <atomic>
+# include <cstdint>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <vector>
+# include <opencv2/core/core.hpp>
+# include <opencv2/highgui/highgui.hpp>
+
+// Prefix of the inputs read from a ring, as in "shm://camera0"
+#define SHM_INPUT_PREFIX "shm://"
+#define SHM_RING_MAGIC "FRAMERNG"
+#define SHM_RING_VERSION 1
+
+/**
+ * @brief Start of the shared memory, followed by the slots.
+ * The producer publishes frame n in slot n % slot_count and then raises write_sequence to n + 1.
+ * The consumer raises read_sequence once it is done with the frames before it, which frees their slots.
+ * Both counters only grow and each is written by one side only, so no lock is shared between the processes.
+ */
+struct ShmRingHeader
+{
+    char magic[8];                              // SHM_RING_MAGIC, written last by the producer once the ring is set up
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;                              // OpenCV type of the pixels, CV_8UC3 for BGR
+    uint32_t step;                              // Bytes from one row to the next
+    uint64_t slot_size;                         // Bytes from one slot to the next, its header included
+    uint64_t data_offset;                       // Offset of the first slot from the start of the ring
+    double fps;                                 // Frame rate of the source, 0 if unknown
+    alignas(64) std::atomic<uint64_t> write_sequence;
+    alignas(64) std::atomic<uint64_t> read_sequence;
+    alignas(64) std::atomic<uint32_t> closed;   // Set by the producer after its last frame
+};
+
+/**
+ * @brief Start of a slot, followed by the pixels of the frame
+ */
+struct alignas(64) ShmSlotHeader
+{
+    std::atomic<uint64_t> sequence;             // Sequence number of the frame in the slot
+    uint64_t timestamp_ns;                      // Time the frame was captured, in nanoseconds since the epoch
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The counters of the ring have to be lock free to be shared between processes");
+
+/**
+ * @brief Memory mapping of a ring, shared by the capture and the frames still in use when the capture is released
+ */
+class ShmRing
+{
+    private:
+        std::string name;
+        void *memory = nullptr;
+        size_t size = 0;
+        bool owner = false;
+        std::mutex lock;
+        std::vector<bool> released;   // Frames given back by the consumer, by slot, ahead of read_sequence
+
+    public:
+        ShmRingHeader *header = nullptr;
+
+        ShmRing(const ShmRing&) = delete;
+        ShmRing& operator=(const ShmRing&) = delete;
+
+        /**
+         * @brief Create a new ring, replacing any ring of the same name
+         * @param name - Name of the shared memory object, without the leading slash
+         * @param slot_count - Number of frames the ring holds
+         * @param width, height, type - Size and type of the frames
+         * @param fps - Frame rate of the source, 0 if unknown
+         * @return nullptr if the shared memory could not be created
+         */
+        static std::shared_ptr<ShmRing> create(const std::string &name, int slot_count, int width, int height, int type, double fps);
+
+        /**
+         * @brief Open a ring created by a producer
+         * @return nullptr if there is no such ring or it is not set up yet
+         */
+        static std::shared_ptr<ShmRing> open(const std::string &name);
+
+        ShmRing(const std::string &name, void *memory, size_t size, bool owner);
+
+        /**
+         * @brief Unmap the ring, and remove its name if this process created it
+         */
+        ~ShmRing();
+
+        /**
+         * @brief Slot holding frame sequence
+         */
+        ShmSlotHeader *slot(uint64_t sequence) const;
+
+        /**
+         * @brief Pixels of the frame in a slot
+         */
+        uint8_t *pixels(ShmSlotHeader *slot) const { return (uint8_t*)slot + sizeof(ShmSlotHeader); }
+
+        /**
+         * @brief Give a frame back to the producer. The frames can be released in any order,
+         * read_sequence only moves past the frames which have all been released
+         * @param sequence - Sequence number of the frame
+         */
+        void release(uint64_t sequence);
+};
+
+/**
+ * @brief Writes frames into a new ring, for a grabber process
+ */
+class ShmRingProducer
+{
+    private:
+        std::shared_ptr<ShmRing> ring;
+
+    public:
+
+        /**
+         * @brief Constructor, creates the ring
+         * @param name - Name of the ring, without the shm:// prefix
+         * @param slot_count - Number of frames the ring holds
+         * @param size - Size of the frames, which are BGR
+         * @param fps - Frame rate of the source, 0 if unknown
+         */
+        ShmRingProducer(const std::string &name, int slot_count, cv::Size size, double fps);
+
+        /**
+         * @brief Destructor, closes the ring
+         */
+        ~ShmRingProducer();
+
+        /**
+         * @brief True if the ring has been created
+         */
+        bool isOpened() const { return ring != nullptr; }
+
+        /**
+         * @brief Copy a frame to the next slot and publish it
+         * @param frame - BGR frame of the size of the ring
+         * @param timestamp_ns - Capture time in nanoseconds since the epoch
+         * @param wait - Wait for the consumer to free a slot when the ring is full, instead of dropping the frame
+         * @return false if the frame was dropped
+         */
+        bool publish(const cv::Mat &frame, uint64_t timestamp_ns, bool wait = true);
+
+        /**
+         * @brief Tell the consumer that no frame follows
+         */
+        void close();
+};
+
+/**
+ * @brief Reads the frames of a ring as a VideoCapture. retrieve() wraps the pixels of the slot in a Mat without copying them,
+ * and the slot goes back to the producer once the last copy of that Mat is released, wherever in the pipeline it is.
+ * The slots are released in order, so one frame kept aside holds back the whole ring: the pipeline copies the frames
+ * which outlive the segmentation. The frames queued between the capture and the segmentation stay in their slots,
+ * so the ring needs queue_size + 2 slots for the queue to fill up.
+ * CAP_PROP_POS_MSEC gives the capture time of the last grabbed frame, in milliseconds since the epoch.
+ * The grab ends the stream once the producer closes the ring, or after 10 seconds without any frame.
+ */
+class ShmCapture : public cv::VideoCapture
+{
+    private:
+        std::shared_ptr<ShmRing> ring;
+        uint64_t next_sequence = 0;
+        uint64_t grabbed_sequence = 0;
+        bool grabbed = false;         // A frame has been grabbed and not handed over yet
+        uint64_t timestamp_ns = 0;
+
+        void dropGrabbed();
+
+    public:
+
+        /**
+         * @brief Constructor, opens the ring
+         * @param name - Name of the ring, without the shm:// prefix
+         */
+        explicit ShmCapture(const std::string &name);
+
+        ~ShmCapture();
+
+        /**
+         * @brief Number of frames the ring holds, 0 when it is not open
+         */
+        int slots() const;
+
+        bool isOpened() const override;
+        bool grab() override;
+        bool retrieve(cv::OutputArray image, int flag = 0) override;
+        bool read(cv::OutputArray image) override;
+        double get(int property) const override;
+        void release() override;
+};
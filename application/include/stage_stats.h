@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the latency histograms of the stages of the pipeline and their publication to InfluxDB
+ */
+
+# pragma once
+# include <atomic>
+# include <chrono>
+# include <condition_variable>
+# include <cstdint>
+# include <mutex>
+# include <thread>
+# include "allocation_count.h"
+# include "influx_writer.h"
+
+/**
+ * @brief Timed steps of the processing of a frame
+ */
+enum Stage
+{
+    STAGE_CAPTURE,          // Grabbing a frame from the stream
+    STAGE_RETRIEVE,         // Decoding a grabbed frame to BGR, only for the frames analysed or shown
+    STAGE_SEGMENTATION,     // HSV conversion, thresholding and morphology
+    STAGE_FIND_CONTOURS,
+    STAGE_ORIENTATION,
+    STAGE_COLOR,
+    STAGE_CRACK,
+    STAGE_IMAGE_WRITE,      // Encoding and writing the image of an object
+    STAGE_DATABASE_WRITE,   // Sending a batch of points to InfluxDB
+    STAGE_COUNT
+};
+
+/**
+ * @brief Name of a stage, as tagged in the PipelineStats measurement
+ */
+const char *stage_name(Stage stage);
+
+/**
+ * @brief Histogram of latencies in nanoseconds with fixed, logarithmic buckets.
+ * Every power of two is split in 16 linear buckets, so a recorded value is known within 6%,
+ * from 1 ns up to about 30 minutes. Recording is a few instructions and never allocates.
+ */
+class LatencyHistogram
+{
+    public:
+        static const int SUB_BUCKETS = 16;
+        static const int BUCKETS = 38 * SUB_BUCKETS;
+
+    private:
+        uint32_t counts[BUCKETS];
+        uint64_t total;
+        uint64_t sum;
+        uint64_t maximum;
+
+        static int bucket(uint64_t value);
+        static uint64_t bucket_limit(int index);
+
+    public:
+
+        LatencyHistogram() { reset(); }
+
+        /**
+         * @brief Add a latency
+         * @param ns - Latency in nanoseconds
+         */
+        void record(uint64_t ns);
+
+        /**
+         * @brief Add all the latencies of another histogram
+         */
+        void add(const LatencyHistogram &other);
+
+        /**
+         * @brief Remove all the latencies
+         */
+        void reset();
+
+        /**
+         * @brief Number of latencies recorded
+         */
+        uint64_t count() const { return total; }
+
+        /**
+         * @brief Largest latency in nanoseconds
+         */
+        uint64_t max() const { return maximum; }
+
+        /**
+         * @brief Average latency in nanoseconds
+         */
+        double mean() const { return total > 0 ? double(sum) / total : 0; }
+
+        /**
+         * @brief Latency in nanoseconds below which a fraction of the latencies fall
+         * @param fraction - 0.5 for the median, 0.99 for the 99th percentile
+         */
+        uint64_t percentile(double fraction) const;
+};
+
+/**
+ * @brief Add a latency to the histogram of a stage for the calling thread.
+ * Every thread records into its own histograms, so the threads never wait for each other
+ */
+void recordLatency(Stage stage, uint64_t ns);
+
+/**
+ * @brief Move the latencies recorded by all the threads since the last call into histograms
+ * @param histograms - Receives the latencies of each stage, added to what they already hold
+ */
+void collectLatencies(LatencyHistogram (&histograms)[STAGE_COUNT]);
+
+/**
+ * @brief Turn the recording of the latencies on or off, off by default
+ */
+void enableLatencies(bool enabled);
+
+/**
+ * @brief True if the latencies are recorded
+ */
+bool latenciesEnabled();
+
+# ifdef COUNT_ALLOCATIONS
+/**
+ * @brief Heap allocations counted by a stage
+ */
+struct AllocationCount
+{
+    uint64_t calls = 0;
+    uint64_t allocations = 0;
+    uint64_t allocation_free_calls = 0;   // Calls that did not allocate at all
+};
+
+/**
+ * @brief Add the heap allocations of one call of a stage
+ */
+void recordAllocations(Stage stage, uint64_t allocations);
+
+/**
+ * @brief Heap allocations of a stage since the start, summed over all the threads
+ */
+AllocationCount stageAllocations(Stage stage);
+# endif
+
+/**
+ * @brief Records the time from its construction to its destruction as a latency of a stage.
+ * The debug builds also count the heap allocations made in between
+ */
+class StageTimer
+{
+    private:
+        Stage stage;
+        bool enabled;
+        std::chrono::steady_clock::time_point start;
+# ifdef COUNT_ALLOCATIONS
+        uint64_t allocations = threadAllocations();
+# endif
+
+    public:
+        explicit StageTimer(Stage stage) : stage(stage), enabled(latenciesEnabled())
+        {
+            if (enabled)
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~StageTimer()
+        {
+# ifdef COUNT_ALLOCATIONS
+            // Counted first, recording the latency may allocate the histograms of a new thread
+            recordAllocations(stage, threadAllocations() - allocations);
+# endif
+            if (enabled)
+                recordLatency(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+};
+
+/**
+ * @brief Publishes the latencies of the stages every few seconds as points of the PipelineStats measurement,
+ * one per stage tagged by its name, with the number of calls and the median, 99th percentile, mean and maximum in microseconds
+ */
+class StatsReporter
+{
+    private:
+        influx::AsyncWriter &writer;
+        std::chrono::milliseconds interval;
+        LatencyHistogram current[STAGE_COUNT];   // Latencies since the last publication
+        LatencyHistogram totals[STAGE_COUNT];
+        bool stopping = false;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread worker;
+
+        void run();
+        void publish();
+
+    public:
+
+        /**
+         * @brief Constructor, turns the recording on and starts publishing
+         * @param writer - Writer the points are queued to
+         * @param interval_ms - Time between two publications
+         */
+        StatsReporter(influx::AsyncWriter &writer, int interval_ms);
+
+        StatsReporter(const StatsReporter&) = delete;
+        StatsReporter& operator=(const StatsReporter&) = delete;
+
+        ~StatsReporter();
+
+        /**
+         * @brief Publish the last latencies and stop
+         */
+        void close();
+
+        /**
+         * @brief Latencies of a stage over the whole run, complete once closed
+         */
+        const LatencyHistogram& total(Stage stage) const { return totals[stage]; }
+};
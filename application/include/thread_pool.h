@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the pool of worker threads running the analysis tasks
+ */
+
+# pragma once
+# include <algorithm>
+# include <condition_variable>
+# include <future>
+# include <memory>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+/**
+ * @brief Tasks handed to a ThreadPool with post(), waited for together by the thread which posted them
+ */
+class TaskGroup
+{
+    private:
+        friend class ThreadPool;
+        int pending = 0;
+        std::mutex lock;
+        std::condition_variable finished;
+
+    public:
+
+        /**
+         * @brief Wait until all the tasks of the group have run
+         */
+        void wait()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            finished.wait(guard, [this] { return pending == 0; });
+        }
+};
+
+/**
+ * @brief Fixed set of worker threads taking tasks from a shared queue
+ */
+class ThreadPool
+{
+    private:
+        struct Task
+        {
+            void (*run)(void *context);
+            void *context;
+            TaskGroup *group;
+        };
+
+        std::vector<std::thread> workers;
+        // Queued tasks from next_task on. The queue empties often, and then starts over in the memory it has grown
+        std::vector<Task> tasks;
+        size_t next_task = 0;
+        bool stopping = false;
+        std::mutex lock;
+        std::condition_variable task_ready;
+
+        void run()
+        {
+            for (;;)
+            {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    task_ready.wait(guard, [this] { return stopping || next_task < tasks.size(); });
+                    if (next_task == tasks.size())
+                        return;
+                    task = tasks[next_task++];
+                    if (next_task == tasks.size())
+                    {
+                        tasks.clear();
+                        next_task = 0;
+                    }
+                }
+                task.run(task.context);
+                if (task.group != nullptr)
+                {
+                    std::lock_guard<std::mutex> guard(task.group->lock);
+                    if (--task.group->pending == 0)
+                        task.group->finished.notify_all();
+                }
+            }
+        }
+
+        void queue(const Task &task)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                tasks.push_back(task);
+            }
+            task_ready.notify_one();
+        }
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param threads - Number of worker threads, 0 to use one per CPU core
+         */
+        explicit ThreadPool(size_t threads)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t i = 0; i < threads; i++)
+                workers.push_back(std::thread(&ThreadPool::run, this));
+        }
+
+        /**
+         * @brief Finish the queued tasks and stop the worker threads
+         */
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            task_ready.notify_all();
+            for (auto &worker : workers)
+                worker.join();
+        }
+
+        /**
+         * @brief Queue a task to be run by one of the worker threads
+         * @param task - Callable taking no arguments
+         * @return Future holding the value returned by the task
+         */
+        template <typename F>
+        auto submit(F task) -> std::future<decltype(task())>
+        {
+            typedef std::packaged_task<decltype(task())()> Packaged;
+            Packaged *packaged = new Packaged(std::move(task));
+            auto result = packaged->get_future();
+            queue({[](void *context)
+            {
+                std::unique_ptr<Packaged> packaged(static_cast<Packaged*>(context));
+                (*packaged)();
+            }, packaged, nullptr});
+            return result;
+        }
+
+        /**
+         * @brief Queue a task to be run by one of the worker threads, without allocating unlike submit().
+         * The task is not copied: it must live until the group has been waited for, and must not throw
+         * @param task - Callable taking no arguments, its result is ignored
+         * @param group - Group to wait for the task with
+         */
+        template <typename F>
+        void post(F &task, TaskGroup &group)
+        {
+            {
+                std::lock_guard<std::mutex> guard(group.lock);
+                group.pending++;
+            }
+            queue({[](void *context) { (*static_cast<F*>(context))(); }, &task, &group});
+        }
+
+        /**
+         * @brief Number of worker threads
+         */
+        size_t size() const { return workers.size(); }
+};
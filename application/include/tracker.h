@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Header file for the centroid tracker deciding when an object is inspected
+ */
+
+# pragma once
+# include <utility>
+# include <vector>
+# include <opencv2/core/core.hpp>
+# include "inspection.h"
+
+#define TRACKED_SAMPLES 16   // Tracks usually alive at once, each holding the contours of its best sample
+
+/**
+ * @brief Settings of the tracker
+ */
+struct TrackerConfig
+{
+    bool enabled = false;      // Track the objects instead of checking every Nth frame
+    char axis = 'x';           // Axis along which the objects move, 'x' or 'y'
+    float line = 0.5;          // Position of the trigger line as a fraction of the frame width (or height)
+    float max_distance = 100;  // Largest move of a centroid between two frames, in pixels
+    int max_missed = 5;        // Frames a track survives without being matched
+    float jitter = 10;         // Largest wobble of a centroid from one frame to the next, in pixels, which is not a move
+    int receding_frames = 3;   // Frames in a row a track must move away from the line to be taken as started past it
+};
+
+/**
+ * @brief Associates the objects found on consecutive frames by the distance between their centroids.
+ * Every track keeps the sample in which the object is closest to the trigger line,
+ * and hands it over once the object has crossed the line. Each object is thus inspected exactly once.
+ */
+class CentroidTracker
+{
+    private:
+        struct Track
+        {
+            int id;
+            cv::Point2f centroid;
+            int missed;
+            bool positive_side;   // Side of the trigger line on which the track started
+            int receding;         // Frames in a row on which the track was farther than the jitter from its best sample
+            bool crossed;         // True once the centroid has crossed the trigger line
+            bool done;            // True once the best sample has been handed over
+            float best_distance;  // Distance from the trigger line of the best sample
+            ObjectSample best;
+        };
+
+        TrackerConfig config;
+        std::vector<Track> tracks;
+        // Matching of a frame, kept from one frame to the next so that their memory is reused
+        std::vector<bool> track_matched, candidate_matched;
+        std::vector<std::pair<float, std::pair<size_t, size_t>>> pairs;
+        int next_id = 0;
+        int started_past = 0;
+
+        float lineOffset(const cv::Point2f &centroid, cv::Size frame_size) const;
+
+    public:
+
+        /**
+         * @brief Constructor
+         * @param config - Settings of the tracker
+         */
+        explicit CentroidTracker(const TrackerConfig &config);
+
+        /**
+         * @brief Match the objects of a new frame with the existing tracks
+         * @param candidates - Objects found on the frame
+         * @param frame_size - Size of the frame
+         * @param ready - Receives the samples of the objects that have crossed the trigger line, to be inspected
+         */
+        void update(const std::vector<ObjectSample> &candidates, cv::Size frame_size, std::vector<ObjectSample> &ready);
+
+        /**
+         * @brief Hand over the tracks which crossed the trigger line but are not done yet, at the end of the stream
+         * @param ready - Receives their samples
+         */
+        void flush(std::vector<ObjectSample> &ready);
+
+        /**
+         * @brief Number of tracks started so far
+         */
+        int tracks_started() const { return next_id; }
+
+        /**
+         * @brief Number of tracks which started past the trigger line, after a missed frame or on a stream starting mid-belt.
+         * They never cross the line, their object is inspected on their first sample once they are seen moving away from it:
+         * farther from the line than their closest sample by more than the jitter, on receding_frames frames in a row
+         */
+        int tracks_started_past() const { return started_past; }
+};
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The builds defining COUNT_ALLOCATIONS interpose every allocation function of glibc: malloc, calloc, realloc,
+ * reallocarray and the aligned ones, posix_memalign, aligned_alloc, memalign, valloc and pvalloc, which cv::fastMalloc
+ * can use. operator new allocates through malloc, so it is counted as well.
+ * The thread counter is a plain thread local integer, the process counter a relaxed atomic, so counting neither
+ * allocates nor takes a lock. Without glibc only operator new is counted
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include "allocation_count.h"
+
+#ifdef COUNT_ALLOCATIONS
+using namespace std;
+
+static thread_local uint64_t thread_allocations = 0;
+static atomic<uint64_t> process_allocations(0);
+
+static inline void countAllocation()
+{
+    thread_allocations++;
+    process_allocations.fetch_add(1, memory_order_relaxed);
+}
+
+uint64_t threadAllocations()
+{
+    return thread_allocations;
+}
+
+uint64_t processAllocations()
+{
+    return process_allocations.load(memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void *__libc_valloc(size_t size);
+extern "C" void *__libc_pvalloc(size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void *reallocarray(void *pointer, size_t count, size_t size)
+{
+    countAllocation();
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return __libc_realloc(pointer, count * size);
+}
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    countAllocation();
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+        return EINVAL;
+    void *memory = __libc_memalign(alignment, size);
+    if (memory == nullptr)
+        return ENOMEM;
+    *pointer = memory;
+    return 0;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *valloc(size_t size)
+{
+    countAllocation();
+    return __libc_valloc(size);
+}
+
+extern "C" void *pvalloc(size_t size)
+{
+    countAllocation();
+    return __libc_pvalloc(size);
+}
+#else
+void *operator new(size_t size)
+{
+    countAllocation();
+    void *memory = malloc(size);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+#endif
+#endif
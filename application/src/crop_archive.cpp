@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "crop_archive.h"
+
+using namespace std;
+
+static const char DATA_MAGIC[8] = {'C', 'R', 'O', 'P', 'D', 'A', 'T', '1'};
+static const char INDEX_MAGIC[8] = {'C', 'R', 'O', 'P', 'I', 'D', 'X', '1'};
+static const size_t FILE_BUFFER = 1 << 20;
+
+const char *const crop_categories[4] = {"crack", "color", "orientation", "no_defect"};
+
+uint8_t crop_category(const string &name)
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        if (name == crop_categories[i])
+            return i;
+    }
+    return 3;
+}
+
+string CropArchive::data_path(const string &prefix, int segment)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "-%05d.dat", segment);
+    return prefix + name;
+}
+
+string CropArchive::index_path(const string &prefix, int segment)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "-%05d.idx", segment);
+    return prefix + name;
+}
+
+CropArchive::CropArchive(const string &prefix, size_t segment_bytes)
+    : prefix(prefix), segment_bytes(segment_bytes), appended(0)
+{
+    // Remove the segments of the previous run, a handful of files instead of one per image
+    for (int number = 0; unlink(data_path(prefix, number).c_str()) == 0; number++)
+        unlink(index_path(prefix, number).c_str());
+    unlink(streams_path(prefix).c_str());
+    open_segment(0);
+}
+
+CropArchive::~CropArchive()
+{
+    close();
+}
+
+bool CropArchive::open_segment(int number)
+{
+    segment = number;
+    data_file = fopen(data_path(prefix, number).c_str(), "wb");
+    index_file = fopen(index_path(prefix, number).c_str(), "wb");
+    if (data_file == nullptr || index_file == nullptr)
+    {
+        cout << "Could not open the image archive " << data_path(prefix, number) << ": " << strerror(errno) << endl;
+        close_segment();
+        return false;
+    }
+    setvbuf(data_file, nullptr, _IOFBF, FILE_BUFFER);
+    fwrite(DATA_MAGIC, 1, sizeof(DATA_MAGIC), data_file);
+    fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC), index_file);
+    data_offset = sizeof(DATA_MAGIC);
+    return true;
+}
+
+void CropArchive::close_segment()
+{
+    if (data_file != nullptr)
+        fclose(data_file);
+    if (index_file != nullptr)
+        fclose(index_file);
+    data_file = nullptr;
+    index_file = nullptr;
+}
+
+bool CropArchive::append(CropIndexEntry entry, const void *data, size_t size)
+{
+    lock_guard<mutex> guard(lock);
+    if (data_file != nullptr && data_offset > sizeof(DATA_MAGIC) && data_offset + size > segment_bytes)
+    {
+        close_segment();
+        open_segment(segment + 1);
+    }
+    if (data_file == nullptr)
+        return false;
+
+    entry.offset = data_offset;
+    entry.size = size;
+    // The data goes first, a reader ignores an index entry whose data is not there yet
+    if (fwrite(data, 1, size, data_file) != size || fwrite(&entry, sizeof(entry), 1, index_file) != 1)
+        return false;
+    data_offset += size;
+    appended++;
+    return true;
+}
+
+uint16_t CropArchive::stream_id(const string &name)
+{
+    lock_guard<mutex> guard(lock);
+    for (size_t id = 0; id < streams.size(); id++)
+    {
+        if (streams[id] == name)
+            return id;
+    }
+    streams.push_back(name);
+    ofstream file(streams_path(prefix), ios::app);
+    file << name << endl;
+    return streams.size() - 1;
+}
+
+void CropArchive::flush()
+{
+    lock_guard<mutex> guard(lock);
+    if (data_file != nullptr)
+    {
+        fflush(data_file);
+        fflush(index_file);
+    }
+}
+
+void CropArchive::close()
+{
+    lock_guard<mutex> guard(lock);
+    close_segment();
+}
+
+CropArchiveReader::~CropArchiveReader()
+{
+    for (const auto &mapping : mappings)
+        munmap(mapping.address, mapping.size);
+}
+
+const uint8_t *CropArchiveReader::map(const string &path, size_t &size)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *address = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(DATA_MAGIC))
+        address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return nullptr;
+    size = st.st_size;
+    mappings.push_back({address, size});
+    return (const uint8_t*)address;
+}
+
+bool CropArchiveReader::open(const string &prefix)
+{
+    ifstream names(CropArchive::streams_path(prefix));
+    string name;
+    while (getline(names, name))
+        streams.push_back(name);
+
+    for (int segment = 0; ; segment++)
+    {
+        size_t data_size = 0, index_size = 0;
+        const uint8_t *data = map(CropArchive::data_path(prefix, segment), data_size);
+        const uint8_t *index = data ? map(CropArchive::index_path(prefix, segment), index_size) : nullptr;
+        if (data == nullptr || index == nullptr)
+            return segment > 0;
+        if (memcmp(data, DATA_MAGIC, sizeof(DATA_MAGIC)) != 0 || memcmp(index, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+        {
+            cout << "Segment " << segment << " of " << prefix << " is not an image archive" << endl;
+            return segment > 0;
+        }
+
+        // A partially written last entry is cut off by the division
+        size_t count = (index_size - sizeof(INDEX_MAGIC)) / sizeof(CropIndexEntry);
+        const CropIndexEntry *entries = (const CropIndexEntry*)(index + sizeof(INDEX_MAGIC));
+        for (size_t i = 0; i < count; i++)
+        {
+            if (entries[i].offset < sizeof(DATA_MAGIC) || entries[i].offset + entries[i].size > data_size)
+                break;
+            crops.push_back({&entries[i], data + entries[i].offset, segment});
+        }
+    }
+}
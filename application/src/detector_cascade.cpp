@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include "detector_cascade.h"
+
+using namespace std;
+
+static const char *detector_names[DETECTOR_COUNT] = {"orientation", "color", "crack"};
+
+// Expected time of the detectors on one object, each of them running only when none before it found a defect
+static double expectedCost(const vector<Detector> &order, const DetectorStats *stats)
+{
+    double cost = 0, reached = 1;
+    for (Detector detector : order)
+    {
+        cost += reached * stats[detector].mean_ns();
+        reached *= 1 - stats[detector].hit_rate();
+    }
+    return cost;
+}
+
+const char *detector_name(Detector detector)
+{
+    return detector_names[detector];
+}
+
+Detector parse_detector(const string &name)
+{
+    for (int detector = 0; detector < DETECTOR_COUNT; detector++)
+        if (name == detector_names[detector])
+            return (Detector)detector;
+    return DETECTOR_COUNT;
+}
+
+DetectorCascade::DetectorCascade(const CascadeConfig &config) : config(config)
+{
+    for (const string &name : config.order)
+    {
+        Detector detector = parse_detector(name);
+        if (detector == DETECTOR_COUNT)
+            cout << "WARNING:: Unknown detector " << name << " in the cascade order, ignored" << endl;
+        else if (find(current.begin(), current.end(), detector) == current.end())
+            current.push_back(detector);
+    }
+    for (int detector = 0; detector < DETECTOR_COUNT; detector++)
+        if (find(current.begin(), current.end(), (Detector)detector) == current.end())
+            current.push_back((Detector)detector);
+}
+
+bool DetectorCascade::auditNext() const
+{
+    return config.audit_every > 0 && object_count % config.audit_every == 0;
+}
+
+void DetectorCascade::record(Detector detector, uint64_t ns, bool defect)
+{
+    stats[detector].runs++;
+    stats[detector].hits += defect;
+    stats[detector].total_ns += ns;
+    ran |= 1u << detector;
+}
+
+bool DetectorCascade::finishObject(bool audit)
+{
+    object_count++;
+    if (audit)
+        audit_count++;
+    else if (ran != (1u << DETECTOR_COUNT) - 1)
+    {
+        stopped_count++;
+        for (int detector = 0; detector < DETECTOR_COUNT; detector++)
+            if (!(ran & (1u << detector)))
+                saved += stats[detector].mean_ns();
+    }
+    ran = 0;
+
+    if (!config.adaptive)
+        return false;
+    for (const DetectorStats &detector : stats)
+        if (detector.runs < CASCADE_MIN_RUNS)
+            return false;
+
+    // Cheapest per defect found first. Stable, so that detectors scoring the same keep their order
+    vector<Detector> sorted = current;
+    stable_sort(sorted.begin(), sorted.end(), [this](Detector a, Detector b)
+    {
+        return stats[a].mean_ns() / stats[a].hit_rate() < stats[b].mean_ns() / stats[b].hit_rate();
+    });
+    // Only for a clear gain, so that two detectors scoring about the same do not swap back and forth
+    if (sorted == current || expectedCost(sorted, stats) > (1 - CASCADE_MIN_GAIN) * expectedCost(current, stats))
+        return false;
+    current = sorted;
+    reorder_count++;
+    return true;
+}
+
+string DetectorCascade::order_text() const
+{
+    string text;
+    for (Detector detector : current)
+        text += (text.empty() ? "" : ", ") + string(detector_name(detector));
+    return text;
+}
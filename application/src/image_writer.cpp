@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <opencv2/highgui/highgui.hpp>
+#include "image_writer.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+ImageFormat parse_image_format(const string &name)
+{
+    if (name == "jpg" || name == "jpeg")
+        return ImageFormat::Jpeg;
+    if (name == "raw")
+        return ImageFormat::Raw;
+    if (name != "png")
+        cout << "WARNING:: Unknown image format " << name << ", saving PNG" << endl;
+    return ImageFormat::Png;
+}
+
+ImageWriter::ImageWriter(const ImageWriterConfig &config)
+    : config(config), jobs(config.queue_size), saved(0), dropped(0), skipped(0), failed(0)
+{
+    switch (config.format)
+    {
+    case ImageFormat::Jpeg:
+        extension = "jpg";
+        params = {IMWRITE_JPEG_QUALITY, config.jpeg_quality};
+        break;
+    case ImageFormat::Raw:
+        extension = "ppm";
+        params = {IMWRITE_PXM_BINARY, 1};
+        break;
+    default:
+        extension = "png";
+        params = {IMWRITE_PNG_COMPRESSION, config.png_compression};
+        break;
+    }
+    if (!config.archive.empty())
+        archive.reset(new CropArchive(config.archive, config.archive_segment_mb << 20));
+    size_t threads = config.threads > 0 ? config.threads : 1;
+    for (size_t i = 0; i < threads; i++)
+        workers.emplace_back(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+    close();
+}
+
+bool ImageWriter::save(const string &category, const string &stream, int number, const Mat &image, uint8_t defects, float length, float width)
+{
+    auto rate = config.save_every.find(category);
+    if (rate != config.save_every.end() && rate->second > 1)
+    {
+        long count;
+        {
+            lock_guard<mutex> guard(lock);
+            count = seen[category]++;
+        }
+        if (count % rate->second != 0)
+        {
+            skipped++;
+            return false;
+        }
+    }
+
+    Job job;
+    if (archive)
+    {
+        job.entry.number = number;
+        job.entry.timestamp = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        job.entry.cols = image.cols;
+        job.entry.rows = image.rows;
+        job.entry.length = length;
+        job.entry.width = width;
+        job.entry.category = crop_category(category);
+        job.entry.defects = defects;
+        job.entry.channels = image.channels();
+        job.entry.stream = archive->stream_id(stream);
+        job.entry.encoding = config.format == ImageFormat::Jpeg ? CROP_JPEG : config.format == ImageFormat::Raw ? CROP_RAW : CROP_PNG;
+    }
+    else
+        job.path = format("%s/%s%sobject_%d.%s", category.c_str(), stream.c_str(), stream.empty() ? "" : "_", number, extension.c_str());
+    job.image = image;
+    if (!jobs.try_push(std::move(job)))
+    {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+/** Encode and write the queued images **/
+void ImageWriter::run()
+{
+    Job job;
+    vector<uchar> encoded;
+    while (jobs.pop(job))
+    {
+        bool written = false;
+        StageTimer timer(STAGE_IMAGE_WRITE);
+        try
+        {
+            if (!archive)
+                written = imwrite(job.path, job.image, params);
+            else if (job.entry.encoding == CROP_RAW)
+            {
+                Mat pixels = job.image.isContinuous() ? job.image : job.image.clone();
+                written = archive->append(job.entry, pixels.data, pixels.total() * pixels.elemSize());
+            }
+            else if (imencode("." + extension, job.image, encoded, params))
+                written = archive->append(job.entry, encoded.data(), encoded.size());
+        }
+        catch (const cv::Exception &e)
+        {
+            cout << "Could not save " << job.path << ": " << e.what() << endl;
+        }
+        if (written)
+            saved++;
+        else
+            failed++;
+        // Release the frame as soon as it is written
+        job.image.release();
+        // Let the readers of the archive see the images once the queue is drained
+        if (archive && jobs.size() == 0)
+            archive->flush();
+    }
+}
+
+void ImageWriter::close()
+{
+    jobs.close();
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    if (archive)
+        archive->close();
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include <algorithm>
+# include <cerrno>
+# include <cstdio>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# include <vector>
+# include <zlib.h>
+# include "influx_spool.h"
+
+// First bytes of every record
+#define SPOOL_MAGIC 0x4c4f4f50
+
+/**
+ * @brief Header written before the points of a batch
+ */
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t length;  // Bytes of points following the header
+    uint32_t count;   // Number of points
+    uint32_t crc;     // CRC32 of the points
+};
+
+static bool read_exact(int fd, void* data, size_t size, uint64_t offset)
+{
+    char* bytes = (char*)data;
+    while (size > 0)
+    {
+        ssize_t done = pread(fd, bytes, size, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return false;
+        bytes += done;
+        size -= done;
+        offset += done;
+    }
+    return true;
+}
+
+static bool write_exact(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t done = pwrite(fd, bytes, size, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return false;
+        bytes += done;
+        size -= done;
+        offset += done;
+    }
+    return true;
+}
+
+influx::Spool::Spool(const SpoolConfig& config) : config(config), queued(0), replayed(0), dropped(0)
+{
+    if (config.path.empty())
+        return;
+    fd = open(config.path.c_str(), O_RDWR | O_CREAT, 0644);
+    offset_fd = open((config.path + ".offset").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || offset_fd < 0)
+    {
+        perror("ERROR:: Unable to open the InfluxDB spool");
+        if (fd >= 0)
+            close(fd);
+        if (offset_fd >= 0)
+            close(offset_fd);
+        fd = offset_fd = -1;
+        return;
+    }
+    recover();
+}
+
+influx::Spool::~Spool()
+{
+    stop();
+    if (fd >= 0)
+        close(fd);
+    if (offset_fd >= 0)
+        close(offset_fd);
+}
+
+bool influx::Spool::read_record(uint64_t offset, std::string& payload, uint32_t& count, uint64_t& next)
+{
+    RecordHeader header;
+    // A damaged length would otherwise make it allocate gigabytes
+    if (!read_exact(fd, &header, sizeof(header), offset) || header.magic != SPOOL_MAGIC || header.length > config.max_bytes)
+        return false;
+    payload.resize(header.length);
+    if (header.length > 0 && !read_exact(fd, &payload[0], header.length, offset + sizeof(header)))
+        return false;
+    if (crc32(0, (const Bytef*)payload.data(), payload.size()) != header.crc)
+        return false;
+    count = header.count;
+    next = offset + sizeof(header) + header.length;
+    return true;
+}
+
+// Start of the first valid record after a damaged one at offset, end when there is none.
+// The magic is looked for at every byte, and a candidate is only taken when its whole record checks out
+uint64_t influx::Spool::find_record(uint64_t offset, uint64_t end)
+{
+    const uint32_t magic = SPOOL_MAGIC;
+    std::vector<char> chunk(64 * 1024);
+    std::string payload;
+    uint32_t count;
+    uint64_t next;
+
+    for (uint64_t start = offset + 1; start + sizeof(RecordHeader) <= end; start += chunk.size() - sizeof(magic) + 1)
+    {
+        size_t size = std::min<uint64_t>(chunk.size(), end - start);
+        if (!read_exact(fd, chunk.data(), size, start))
+            return end;
+        for (size_t i = 0; i + sizeof(magic) <= size; i++)
+        {
+            if (memcmp(&chunk[i], &magic, sizeof(magic)) == 0 && read_record(start + i, payload, count, next) && next <= end)
+                return start + i;
+        }
+    }
+    return end;
+}
+
+// Find the valid records, cut off a partially written one, and restore the replay position
+void influx::Spool::recover()
+{
+    struct stat info;
+    uint64_t saved = 0, offset = 0, next, size;
+    uint32_t count;
+    std::string payload;
+    std::vector<std::pair<uint64_t, uint32_t>> records;
+
+    if (fstat(fd, &info) != 0)
+        return;
+    size = info.st_size;
+    if (!read_exact(offset_fd, &saved, sizeof(saved), 0))
+        saved = 0;
+
+    while (offset < size)
+    {
+        if (read_record(offset, payload, count, next))
+        {
+            records.push_back(std::make_pair(offset, count));
+            offset = next;
+            continue;
+        }
+        // A damaged record in the middle of the file only loses itself, the valid records after it are kept
+        uint64_t resume = find_record(offset, size);
+        if (resume == size)
+            break;
+        printf("WARNING:: Skipping %llu bytes of a damaged record of the InfluxDB spool\n", (unsigned long long)(resume - offset));
+        offset = resume;
+    }
+    if (offset < size)
+    {
+        printf("WARNING:: Dropping %llu bytes of a partially written record from the InfluxDB spool\n", (unsigned long long)(size - offset));
+        if (ftruncate(fd, offset) != 0)
+            perror("ERROR:: Unable to truncate the InfluxDB spool");
+    }
+    end_offset = offset;
+
+    // A saved position which is not the start of a record replays the whole spool, the points carry their timestamps
+    read_offset = saved == end_offset ? end_offset : 0;
+    for (const auto& record : records)
+    {
+        if (record.first == saved)
+            read_offset = saved;
+    }
+    for (const auto& record : records)
+    {
+        if (record.first >= read_offset)
+            queued += record.second;
+    }
+
+    if (read_offset == end_offset)
+    {
+        if (ftruncate(fd, 0) != 0)
+            perror("ERROR:: Unable to truncate the InfluxDB spool");
+        read_offset = end_offset = 0;
+    }
+    else
+        printf("InfluxDB spool holds %ld points to be replayed\n", (long)queued);
+    save_offset();
+    dirty = true;
+}
+
+void influx::Spool::save_offset()
+{
+    if (!write_exact(offset_fd, &read_offset, sizeof(read_offset), 0))
+        perror("ERROR:: Unable to save the InfluxDB spool position");
+    dirty = true;
+}
+
+void influx::Spool::sync()
+{
+    fdatasync(fd);
+    fdatasync(offset_fd);
+}
+
+bool influx::Spool::append(const std::string& lines, size_t count)
+{
+    RecordHeader header;
+    header.magic = SPOOL_MAGIC;
+    header.length = lines.size();
+    header.count = count;
+    header.crc = crc32(0, (const Bytef*)lines.data(), lines.size());
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (fd < 0 || end_offset + sizeof(header) + lines.size() > config.max_bytes)
+    {
+        dropped += count;
+        return false;
+    }
+    if (!write_exact(fd, &header, sizeof(header), end_offset) ||
+        !write_exact(fd, lines.data(), lines.size(), end_offset + sizeof(header)))
+    {
+        perror("ERROR:: Unable to write to the InfluxDB spool");
+        if (ftruncate(fd, end_offset) != 0)
+            perror("ERROR:: Unable to truncate the InfluxDB spool");
+        dropped += count;
+        return false;
+    }
+    end_offset += sizeof(header) + lines.size();
+    queued += count;
+    dirty = true;
+    return true;
+}
+
+bool influx::Spool::pending()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return read_offset < end_offset;
+}
+
+void influx::Spool::start(std::function<int(const std::string&)> send)
+{
+    if (fd < 0 || worker.joinable())
+        return;
+    sender = send;
+    next_retry = std::chrono::steady_clock::now();
+    worker = std::thread(&Spool::run, this);
+}
+
+void influx::Spool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+    if (fd >= 0)
+        sync();
+}
+
+void influx::Spool::run()
+{
+    std::string payload;
+    uint32_t count = 0;
+    uint64_t offset, next = 0;
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (!stopping)
+    {
+        wake.wait_for(guard, std::chrono::milliseconds(config.sync_interval_ms), [this] { return stopping; });
+
+        // Flush the records appended since the last pass together
+        if (dirty)
+        {
+            dirty = false;
+            guard.unlock();
+            sync();
+            guard.lock();
+        }
+
+        // Replay the records in order until the database fails again
+        if (read_offset >= end_offset || std::chrono::steady_clock::now() < next_retry)
+            continue;
+        while (!stopping && read_offset < end_offset)
+        {
+            offset = read_offset;
+            guard.unlock();
+            bool valid = read_record(offset, payload, count, next);
+            int status = valid ? sender(payload) : 0;
+            guard.lock();
+
+            if (status != 0)
+            {
+                next_retry = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.retry_interval_ms);
+                break;
+            }
+            if (valid)
+            {
+                read_offset = next;
+                queued -= count;
+                replayed += count;
+            }
+            else
+            {
+                // Skip to the next valid record, and count the points of the valid records left to learn how many were lost
+                uint64_t end = end_offset;
+                long before = queued, remaining = 0;
+                guard.unlock();
+                uint64_t resume = find_record(offset, end);
+                for (uint64_t at = resume; at < end;)
+                {
+                    if (read_record(at, payload, count, next))
+                    {
+                        remaining += count;
+                        at = next;
+                    }
+                    else
+                        at = find_record(at, end);
+                }
+                guard.lock();
+                long lost = before > remaining ? before - remaining : 0;
+                printf("ERROR:: Skipping %llu bytes of a damaged record of the InfluxDB spool, %ld points lost\n",
+                       (unsigned long long)(resume - offset), lost);
+                read_offset = resume;
+                queued -= lost;
+                dropped += lost;
+            }
+
+            // Empty the spool once everything has been sent
+            if (read_offset == end_offset)
+            {
+                if (ftruncate(fd, 0) != 0)
+                    perror("ERROR:: Unable to truncate the InfluxDB spool");
+                read_offset = end_offset = 0;
+            }
+            save_offset();
+        }
+    }
+}
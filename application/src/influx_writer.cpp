@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include <chrono>
+# include <cstring>
+# include <zlib.h>
+# include "influx_writer.h"
+# include "stage_stats.h"
+
+// Compress the body of a request in the gzip format
+static bool gzip_compress(const std::string& input, std::string& output)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // 16 added to the window bits selects the gzip wrapper
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = (Bytef*)input.data();
+    stream.avail_in = input.size();
+    stream.next_out = (Bytef*)&output[0];
+    stream.avail_out = output.size();
+    int status = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+influx::DropPolicy influx::parse_drop_policy(const std::string& name)
+{
+    if (name == "drop_newest")
+        return DropPolicy::DropNewest;
+    if (name == "block")
+        return DropPolicy::Block;
+    return DropPolicy::DropOldest;
+}
+
+influx::AsyncWriter::AsyncWriter(InfluxDB& db, const std::string& db_name, const WriterConfig& config)
+    : db(db), db_name(db_name), config(config), dropped(0), written(0), failed(0), batches(0), spooled(0)
+{
+    if (this->config.batch_size == 0)
+        this->config.batch_size = 1;
+    if (this->config.queue_size < this->config.batch_size)
+        this->config.queue_size = this->config.batch_size;
+    pending.reserve(this->config.batch_size * 128);
+    sending.reserve(this->config.batch_size * 128);
+    if (!this->config.spool.path.empty())
+    {
+        spool.reset(new Spool(this->config.spool));
+        if (spool->is_open())
+            spool->start([this](const std::string& lines) { return send(lines); });
+        else
+            spool.reset();
+    }
+    worker = std::thread(&AsyncWriter::run, this);
+}
+
+influx::AsyncWriter::~AsyncWriter()
+{
+    close();
+}
+
+void influx::AsyncWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+    }
+    wake.notify_all();
+    not_full.notify_all();
+    if (worker.joinable())
+        worker.join();
+    if (spool)
+        spool->stop();
+}
+
+size_t influx::AsyncWriter::depth()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return pending_count;
+}
+
+// Wait or drop queued points until count more fit in the queue
+bool influx::AsyncWriter::make_room(std::unique_lock<std::mutex>& guard, size_t count)
+{
+    if (closing)
+        return false;
+    if (pending_count == 0 || pending_count + count <= config.queue_size)
+        return true;
+    switch (config.drop_policy)
+    {
+    case DropPolicy::DropNewest:
+        dropped += count;
+        return false;
+    case DropPolicy::DropOldest:
+        // The dropped points are skipped by moving the start of the queue, rather than erased from the front of the
+        // buffer, which would move the whole queue for every point
+        while (pending_count > 0 && pending_count + count > config.queue_size)
+        {
+            size_t end = pending.find('\n', pending_start);
+            pending_start = end == std::string::npos ? pending.size() : end + 1;
+            pending_count--;
+            dropped++;
+        }
+        if (pending_count == 0)
+        {
+            pending.clear();
+            pending_start = 0;
+        }
+        else if (pending_start > pending.size() / 2)
+        {
+            // The buffer is compacted once the dropped points take half of it, so that it does not grow without bound
+            pending.erase(0, pending_start);
+            pending_start = 0;
+        }
+        return true;
+    case DropPolicy::Block:
+        not_full.wait(guard, [this, count] { return closing || pending_count == 0 || pending_count + count <= config.queue_size; });
+        return !closing;
+    }
+    return true;
+}
+
+bool influx::AsyncWriter::write(Data& data)
+{
+    if (!data.has_timestamp())
+        data.add_timestamp(now_ns());
+    std::string line = data.build_query();
+    if (line.empty())
+        return false;
+
+    std::unique_lock<std::mutex> guard(lock);
+    if (!make_room(guard, 1))
+        return false;
+    if (pending_count > 0)
+        pending += '\n';
+    pending += line;
+    pending_count++;
+    if (pending_count >= config.batch_size)
+        wake.notify_one();
+    return true;
+}
+
+bool influx::AsyncWriter::write(const LineBuilder& points)
+{
+    if (points.count() == 0)
+        return true;
+
+    std::unique_lock<std::mutex> guard(lock);
+    if (!make_room(guard, points.count()))
+        return false;
+    if (pending_count > 0)
+        pending += '\n';
+    pending += points.str();
+    pending_count += points.count();
+    if (pending_count >= config.batch_size)
+        wake.notify_one();
+    return true;
+}
+
+void influx::AsyncWriter::run()
+{
+    auto interval = std::chrono::milliseconds(config.flush_interval_ms);
+    auto deadline = std::chrono::steady_clock::now() + interval;
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;)
+    {
+        // Flush when a batch is full, when the interval is over, or when closing
+        wake.wait_until(guard, deadline, [this] { return closing || pending_count >= config.batch_size; });
+        if (pending_count == 0)
+        {
+            if (closing)
+                break;
+            deadline = std::chrono::steady_clock::now() + interval;
+            continue;
+        }
+
+        // Take all the queued points, the buffers are swapped to keep their capacity
+        sending.swap(pending);
+        size_t begin = pending_start;
+        pending.clear();
+        pending_start = 0;
+        pending_count = 0;
+        not_full.notify_all();
+
+        guard.unlock();
+        // A backlog goes out in requests of at most batch_size points, so that a failure only affects its own chunk
+        while (begin < sending.size())
+        {
+            size_t end = sending.find('\n', begin), chunk_count = 1;
+            while (end != std::string::npos && chunk_count < config.batch_size)
+            {
+                end = sending.find('\n', end + 1);
+                chunk_count++;
+            }
+            if (end == std::string::npos)
+                end = sending.size();
+            chunk.assign(sending, begin, end - begin);
+            begin = end + 1;
+            deliver(chunk, chunk_count);
+        }
+        guard.lock();
+
+        deadline = std::chrono::steady_clock::now() + interval;
+    }
+}
+
+// Send one chunk of points, or spool it when the database refuses it or older points are still spooled
+void influx::AsyncWriter::deliver(const std::string& lines, size_t count)
+{
+    if (spool && spool->pending())
+    {
+        // Older points are still waiting in the spool
+        if (spool->append(lines, count))
+            spooled += count;
+        else
+            failed += count;
+    }
+    else if (send(lines) == 0)
+    {
+        written += count;
+        batches++;
+    }
+    else if (spool && spool->append(lines, count))
+        spooled += count;
+    else
+        failed += count;
+}
+
+int influx::AsyncWriter::send(const std::string& lines)
+{
+    StageTimer timer(STAGE_DATABASE_WRITE);
+    if (config.gzip)
+    {
+        std::string compressed;
+        if (gzip_compress(lines, compressed))
+            return db.write_lines(db_name, compressed, true);
+    }
+    return db.write_lines(db_name, lines);
+}
@@ -22,12 +22,14 @@
  */
 
 # include "influxdb.h"
+# include "line_protocol.h"
 
 influx::InfluxDB::InfluxDB()
 {
     host = "localhost";
     port = 8086;
     url = "http://localhost:8086";
+    init();
 }
 
 influx::InfluxDB::InfluxDB(std::string host, int port)
@@ -35,25 +37,58 @@ influx::InfluxDB::InfluxDB(std::string host, int port)
     this->host = host;
     this->port = port;
     url = "http://" + host + ":" + std::to_string(port);
+    init();
 }
 
-
-CURLcode influx::InfluxDB::http_post(std::string _url, std::string data)
+void influx::InfluxDB::init()
 {
-    CURL *handle;
-    CURLcode status;
+    file = fopen("../influx-logs.txt", "w");
     handle = curl_easy_init();
-    curl_easy_setopt(handle, CURLOPT_URL, _url.c_str());
-    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, fwrite);
-    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)file);
     if (handle)
     {
+        // The connection is reused as long as the handle lives, the keepalive probes detect when the peer has gone away
+        curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        // Give up on an unreachable database instead of blocking the writer for minutes
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, 5000L);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, 30000L);
+        if (file)
+        {
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, fwrite);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)file);
+        }
+    }
+    gzip_headers = curl_slist_append(nullptr, "Content-Encoding: gzip");
+}
+
+influx::InfluxDB::~InfluxDB()
+{
+    if (handle)
+        curl_easy_cleanup(handle);
+    curl_slist_free_all(gzip_headers);
+    if (file)
+        fclose(file);
+}
+
+
+CURLcode influx::InfluxDB::http_post(const std::string& _url, const std::string& data)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return perform(_url, data);
+}
+
+CURLcode influx::InfluxDB::perform(const std::string& _url, const std::string& data, struct curl_slist* headers)
+{
+    CURLcode status = CURLE_FAILED_INIT;
+    if (handle)
+    {
+        curl_easy_setopt(handle, CURLOPT_URL, _url.c_str());
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
         curl_easy_setopt(handle, CURLOPT_POSTFIELDS, data.c_str());
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)data.size());
 
         // Send the HTTP POST request
         status = curl_easy_perform(handle);
-        curl_easy_cleanup(handle);
-        handle = NULL;
     }
     return status;
 }
@@ -67,16 +102,14 @@ int influx::InfluxDB::create_database(const std::string& db_name)
     status = http_post(_url, _query);
     if (status != CURLE_OK)
     {
-        printf("Curl failed with code %d (%s)n", status, curl_easy_strerror(status));
+        printf("Curl failed with code %d (%s)\n", status, curl_easy_strerror(status));
         return -1;
     }
     return 0;
 }
 
-int influx::InfluxDB::write_point(std::string db_name, influx::Data data)
+int influx::InfluxDB::write_point(const std::string& db_name, const influx::Data& data)
 {
-    CURLcode status;
-    std::string _url = url + "/write?db=" + db_name;
     std::string _data = data.build_query();
 
     if (_data == "")
@@ -84,10 +117,33 @@ int influx::InfluxDB::write_point(std::string db_name, influx::Data data)
         std::cout<<"ERROR:: Error occured while writing the data. Please check the Format of the data\n";
         return -1;
     }
-    status = http_post(_url, _data.c_str());
+    return write_lines(db_name, _data);
+}
+
+int influx::InfluxDB::write_lines(const std::string& db_name, const std::string& lines, bool gzip)
+{
+    CURLcode status;
+    long response = 0;
+    {
+        // The write url is built once for the database
+        std::lock_guard<std::mutex> guard(lock);
+        if (write_url.empty() || write_db != db_name)
+        {
+            write_db = db_name;
+            write_url = url + "/write?db=" + db_name;
+        }
+        status = perform(write_url, lines, gzip ? gzip_headers : nullptr);
+        if (status == CURLE_OK)
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response);
+    }
     if (status != CURLE_OK)
     {
-        printf("Curl failed with code %d (%s)n", status, curl_easy_strerror(status));
+        printf("Curl failed with code %d (%s)\n", status, curl_easy_strerror(status));
+        return -1;
+    }
+    if (response / 100 != 2)
+    {
+        printf("InfluxDB rejected the write with HTTP status %ld\n", response);
         return -1;
     }
     return 0;
@@ -177,7 +233,7 @@ void influx::Data::add_timestamp(long long _time)
     is_time = true;
 }
 
-std::string influx::Data::build_query()
+std::string influx::Data::build_query() const
 {
     std::string _query;
 
@@ -192,7 +248,7 @@ std::string influx::Data::build_query()
         return "";
     }
 
-    for (auto field : field_data)
+    for (const auto &field : field_data)
     {
         if(_query.empty())
         {
@@ -214,21 +270,9 @@ std::string influx::Data::build_query()
 
 std::string influx::Data::add_escape_seq(std::string data, bool measure)
 {
-        std::string _data = data;
-        if (data.find_first_of(",") != std::string::npos)
-        {
-            _data = std::regex_replace(_data, std::regex(","), "\\,");
-        }
-        if (data.find_first_of(" ") != std::string::npos)
-        {
-            _data = std::regex_replace(_data, std::regex(" "), "\\ ");
-        }
-        if (data.find_first_of("=") != std::string::npos && !measure)
-        {
-            _data = std::regex_replace(_data, std::regex("="), "\\=");
-        }
+        std::string _data;
+        _data.reserve(data.size() + 4);
+        append_escaped(_data, data.data(), data.size(), measure);
 
         return _data;
 }
-
-
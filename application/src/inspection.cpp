@@ -0,0 +1,756 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "buffer_pool.h"
+#include "inspection.h"
+#include "morphology.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * @brief Edges of one tile of the masked crack detection
+ */
+struct TileScore
+{
+    int edge_pixels = 0;
+    int mask_pixels = 0;
+};
+
+/**
+ * @brief Horizontal run of foreground pixels of a mask, from start to end excluded
+ */
+struct Run
+{
+    int y;
+    int start;
+    int end;
+};
+
+/**
+ * @brief Buffers of the segmentation and the detectors, kept from one call to the next so that their memory is reused.
+ * Each thread has its own, so the detectors running concurrently on the thread pool never share them
+ */
+struct Scratch
+{
+    Mat hsv, mask, gray, blurred, edges;
+    vector<vector<Point>> contours;
+    vector<Vec4i> hierarchy;
+    vector<int> defective;
+
+    // Blob extraction: the runs of the mask, the union-find forest linking them into blobs,
+    // the bounding rect of every blob held by its first run, and the runs of the kept blobs grouped by blob
+    vector<Run> runs;
+    vector<int> run_parent, run_blob, blob_runs, blob_offsets;
+    vector<Rect> run_boxes, blob_boxes;
+    Mat blob_canvas;
+    vector<vector<Point>> blob_contours;
+
+    // Coarse to fine localization
+    Mat small, half;
+    vector<vector<Point>> coarse_contours, local_contours;
+    vector<Rect> located;
+
+    // Masked crack detection, the tile buffers are used by the threads running the tiles
+    Mat object_mask, filled_mask, object_edges;
+    Mat tile_gray, tile_blurred, tile_edges;
+    vector<TileScore> tiles;
+};
+
+static Scratch &threadScratch()
+{
+    static thread_local Scratch scratch;
+    return scratch;
+}
+
+// Copy of the image given to a detector, to mark a defect on. The copies live on in the output stage, the display and
+// the image writer, so their buffers are kept per thread and reused once all of them are done. A buffer is reused for any
+// image it can hold, the regions of the objects in ROI mode being of every size
+static Mat defectImage(const Mat &frame)
+{
+    static thread_local FramePool buffers(4);
+    Mat buffer = buffers.acquire();
+    if (buffer.type() != frame.type() || buffer.rows < frame.rows || buffer.cols < frame.cols)
+        buffer.create(max(buffer.rows, frame.rows), max(buffer.cols, frame.cols), frame.type());
+    buffers.keep(buffer);
+    Mat image = buffer(Rect(0, 0, frame.cols, frame.rows));
+    frame.copyTo(image);
+    return image;
+}
+
+static int findRoot(vector<int> &parent, int run)
+{
+    while (parent[run] != run)
+    {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+void findBlobContours(const Mat &mask, int min_box_area, vector<vector<Point>> &contours)
+{
+    Scratch &scratch = threadScratch();
+    vector<Run> &runs = scratch.runs;
+    vector<int> &parent = scratch.run_parent;
+    runs.clear();
+    parent.clear();
+    contours.clear();
+
+    // Split the rows into runs and link every run to the runs of the row above it touches, diagonals included
+    size_t above_begin = 0, above_end = 0;
+    for (int y = 0; y < mask.rows; y++)
+    {
+        const uchar *row = mask.ptr<uchar>(y);
+        size_t row_begin = runs.size();
+        uint64_t word;
+        int x = 0;
+        while (x < mask.cols)
+        {
+            // The background and the inside of the objects are skipped 8 pixels at a time
+            while (x + 8 <= mask.cols && (memcpy(&word, row + x, 8), word == 0))
+                x += 8;
+            while (x < mask.cols && row[x] == 0)
+                x++;
+            if (x == mask.cols)
+                break;
+            int start = x;
+            while (x + 8 <= mask.cols && (memcpy(&word, row + x, 8), word == ~uint64_t(0)))
+                x += 8;
+            while (x < mask.cols && row[x] != 0)
+                x++;
+            runs.push_back({y, start, x});
+            parent.push_back(parent.size());
+        }
+
+        size_t first = above_begin;
+        for (size_t run = row_begin; run < runs.size(); run++)
+        {
+            while (first < above_end && runs[first].end < runs[run].start)
+                first++;
+            for (size_t above = first; above < above_end && runs[above].start <= runs[run].end; above++)
+            {
+                int a = findRoot(parent, above), b = findRoot(parent, run);
+                // The root of a blob stays its first run, so that the blobs come out in raster order
+                if (a != b)
+                    parent[max(a, b)] = min(a, b);
+            }
+        }
+        above_begin = row_begin;
+        above_end = runs.size();
+    }
+
+    // Bounding rect of every blob, kept by its root. Every run is linked straight to its root on the way
+    vector<Rect> &boxes = scratch.run_boxes;
+    boxes.resize(runs.size());
+    for (size_t run = 0; run < runs.size(); run++)
+    {
+        int root = findRoot(parent, run);
+        parent[run] = root;
+        Rect extent(runs[run].start, runs[run].y, runs[run].end - runs[run].start, 1);
+        boxes[root] = root == (int)run ? extent : boxes[root] | extent;
+    }
+
+    // Number the blobs large enough to be traced, -1 for the others
+    vector<int> &blob = scratch.run_blob, &offsets = scratch.blob_offsets;
+    vector<Rect> &blob_boxes = scratch.blob_boxes;
+    blob.assign(runs.size(), -1);
+    blob_boxes.clear();
+    offsets.assign(1, 0);
+    for (size_t run = 0; run < runs.size(); run++)
+    {
+        if (parent[run] == (int)run && boxes[run].area() > min_box_area)
+        {
+            blob[run] = blob_boxes.size();
+            blob_boxes.push_back(boxes[run]);
+            offsets.push_back(0);
+        }
+    }
+    if (blob_boxes.empty())
+        return;
+
+    // Group the runs of the kept blobs by blob
+    vector<int> &grouped = scratch.blob_runs;
+    for (size_t run = 0; run < runs.size(); run++)
+    {
+        blob[run] = blob[parent[run]];
+        if (blob[run] >= 0)
+            offsets[blob[run] + 1]++;
+    }
+    for (size_t i = 1; i < offsets.size(); i++)
+        offsets[i] += offsets[i - 1];
+    grouped.resize(offsets.back());
+    for (size_t run = 0; run < runs.size(); run++)
+        if (blob[run] >= 0)
+            grouped[offsets[blob[run]]++] = run;
+
+    // Trace each kept blob alone, on a canvas just larger than its bounding rect,
+    // so that the other blobs crossing its rect do not add their contours
+    Rect bounds(0, 0, mask.cols, mask.rows);
+    Mat &canvas = scratch.blob_canvas;
+    int begin = 0;
+    for (size_t i = 0; i < blob_boxes.size(); i++)
+    {
+        Rect region = Rect(blob_boxes[i].x - 1, blob_boxes[i].y - 1, blob_boxes[i].width + 2, blob_boxes[i].height + 2) & bounds;
+        canvas.create(region.size(), CV_8UC1);
+        canvas.setTo(Scalar(0));
+        for (int k = begin; k < offsets[i]; k++)
+        {
+            const Run &run = runs[grouped[k]];
+            memset(canvas.ptr<uchar>(run.y - region.y) + run.start - region.x, 255, run.end - run.start);
+        }
+        begin = offsets[i];
+
+        findContours(canvas, scratch.blob_contours, RETR_LIST, CHAIN_APPROX_NONE, region.tl());
+        for (auto &contour : scratch.blob_contours)
+            contours.push_back(std::move(contour));
+    }
+
+    // findContours lists the contours in the reverse order of their first point in raster order. Should two of them
+    // start on the same point, the outer contour comes first: findContours gives it a negative oriented area, a hole a positive one
+    stable_sort(contours.begin(), contours.end(), [](const vector<Point> &a, const vector<Point> &b)
+    {
+        if (a.front() != b.front())
+            return a.front().y != b.front().y ? a.front().y > b.front().y : a.front().x > b.front().x;
+        return contourArea(a, true) <= 0 && contourArea(b, true) > 0;
+    });
+}
+
+void findObjects(const Mat &frame, vector<vector<Point>> &contours, int min_box_area)
+{
+    Scratch &scratch = threadScratch();
+    Mat &img_hsv = scratch.hsv, &img_thresholded = scratch.mask;
+
+    {
+        StageTimer timer(STAGE_SEGMENTATION);
+
+        // Convert RGB image to HSV color space
+        cvtColor(frame, img_hsv, COLOR_RGB2HSV);
+
+        // Thresholding of an Image in a color range
+        inRange(img_hsv, Scalar(LOW_H, LOW_S, LOW_V), Scalar(HIGH_H, HIGH_S, HIGH_V), img_thresholded);
+
+        // Morphological opening (remove small objects from the foreground)
+        // followed by closing (fill small holes in the foreground)
+        openClose(img_thresholded, img_thresholded);
+    }
+
+    // Find the contours on the image, skipping the blobs too small to be an object when there is a limit
+    StageTimer timer(STAGE_FIND_CONTOURS);
+    if (min_box_area > 0)
+        findBlobContours(img_thresholded, min_box_area, contours);
+    else
+        findContours(img_thresholded, contours, RETR_LIST, CHAIN_APPROX_NONE);
+}
+
+void locateObjects(const Mat &frame, int scale, vector<vector<Point>> &contours, bool prefilter)
+{
+    if (scale <= 1)
+    {
+        findObjects(frame, contours, prefilter ? OBJECT_AREA_MIN : 0);
+        return;
+    }
+
+    Scratch &scratch = threadScratch();
+    {
+        StageTimer timer(STAGE_SEGMENTATION);
+        if ((scale & (scale - 1)) == 0)
+        {
+            // Halving is a fast path of the area interpolation, several times faster than dividing by 4 at once
+            resize(frame, scratch.small, Size(frame.cols / 2, frame.rows / 2), 0, 0, INTER_AREA);
+            for (int factor = 4; factor <= scale; factor *= 2)
+            {
+                resize(scratch.small, scratch.half, Size(scratch.small.cols / 2, scratch.small.rows / 2), 0, 0, INTER_AREA);
+                swap(scratch.small, scratch.half);
+            }
+        }
+        else
+            resize(frame, scratch.small, Size(frame.cols / scale, frame.rows / scale), 0, 0, INTER_AREA);
+    }
+
+    // The lower area limit scales with the square of the factor. It is loose here, the exact limits apply to the
+    // full resolution contours. There is no upper limit: a blob larger than an object can be several objects
+    // close on the belt, merged by the downscaling
+    double area_min = 0.75 * OBJECT_AREA_MIN / (scale * scale);
+    findObjects(scratch.small, scratch.coarse_contours, prefilter ? (int)area_min : 0);
+    // Room for a pixel of the downscaled frame on each side and for the morphology at full resolution
+    int margin = 2 * scale + 8;
+    Rect bounds(0, 0, frame.cols, frame.rows);
+    size_t found = 0;
+    scratch.located.clear();
+
+    for (const auto &coarse : scratch.coarse_contours)
+    {
+        Rect object = boundingRect(coarse);
+        if (object.area() <= area_min)
+            continue;
+
+        // Segment the region of the blob again at full resolution. A neighbour close on the belt can reach into the
+        // region, even be larger than the object, so the contours kept are those of an object size whose center is
+        // in the scaled up rect of the blob. A contour cut by a side of the region is part of a neighbour, which is
+        // found whole in its own region
+        Rect scaled(object.x * scale, object.y * scale, object.width * scale, object.height * scale);
+        Rect region = Rect(scaled.x - margin, scaled.y - margin, scaled.width + 2 * margin, scaled.height + 2 * margin) & bounds;
+        findObjects(frame(region), scratch.local_contours);
+        for (const auto &local_contour : scratch.local_contours)
+        {
+            Rect local = boundingRect(local_contour);
+            bool cut = (local.x == 0 && region.x > 0) || (local.y == 0 && region.y > 0) ||
+                       (local.br().x == region.width && region.br().x < frame.cols) ||
+                       (local.br().y == region.height && region.br().y < frame.rows);
+            local += region.tl();
+            Point center(local.x + local.width / 2, local.y + local.height / 2);
+            if (cut || local.area() <= OBJECT_AREA_MIN || local.area() >= OBJECT_AREA_MAX || !scaled.contains(center))
+                continue;
+            // The regions of blobs close to each other overlap, an object is only listed once
+            if (find(scratch.located.begin(), scratch.located.end(), local) != scratch.located.end())
+                continue;
+            scratch.located.push_back(local);
+
+            // Reuse the vectors already in the list, so that their memory is kept from frame to frame
+            if (contours.size() <= found)
+                contours.emplace_back();
+            vector<Point> &contour = contours[found++];
+            contour.clear();
+            for (const Point &point : local_contour)
+                contour.push_back(point + region.tl());
+        }
+    }
+    contours.resize(found);
+}
+
+// Create dataset for PCA Analysis
+Mat createBuffer(const vector<Point> &contour_points)
+{
+    Mat data_points;
+    createBuffer(contour_points, data_points);
+    return data_points;
+}
+
+void createBuffer(const vector<Point> &contour_points, Mat &data_points)
+{
+    data_points.create(contour_points.size(), 2, CV_64FC1);
+    for (int row = 0; row < data_points.rows; row++)
+    {
+        data_points.at<double>(row, 0) = contour_points[row].x;
+        data_points.at<double>(row, 1) = contour_points[row].y;
+    }
+}
+
+// Get the orientation of the object
+double getOrientation(Mat data_points)
+{
+    // Perform PCA Analysis on the data points
+    PCA pca(data_points, Mat(), PCA::DATA_AS_ROW);
+    Point2d eigen_vector;
+    eigen_vector = Point2d(pca.eigenvectors.at<double>(0, 0),
+                           pca.eigenvectors.at<double>(0, 1));
+
+    // Get the orientation in radians
+    double angle = atan2(eigen_vector.y, eigen_vector.x);
+    return angle;
+}
+
+// Get the main axis from the second order central moments
+ObjectOrientation orientationFromMoments(double mu20, double mu11, double mu02)
+{
+    ObjectOrientation orientation;
+
+    // Covariance of the object up to a factor, its eigenvectors are the axes of the object
+    double a = mu20, b = mu11, c = mu02;
+    double half_sum = (a + c) / 2, radius = sqrt((a - c) * (a - c) / 4 + b * b);
+    double major = half_sum + radius, minor = half_sum - radius;
+
+    // The PCA returns the axis with its largest coordinate positive, so the angle is turned by pi below -pi/4
+    orientation.angle = 0.5 * atan2(2 * b, a - c);
+    if (orientation.angle < -CV_PI / 4)
+        orientation.angle += CV_PI;
+    if (major > 0)
+    {
+        orientation.eccentricity = sqrt(max(0.0, 1 - minor / major));
+        orientation.confidence = (major - minor) / (major + minor);
+    }
+    return orientation;
+}
+
+// Get the orientation of the object from the moments of its contour points
+ObjectOrientation contourOrientation(const vector<Point> &contour_points)
+{
+    // Integer sums over the points, so the central moments scaled by n^2 are exact
+    int64_t count = contour_points.size(), sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0, sum_yy = 0;
+    for (const Point &point : contour_points)
+    {
+        sum_x += point.x;
+        sum_y += point.y;
+        sum_xx += (int64_t)point.x * point.x;
+        sum_xy += (int64_t)point.x * point.y;
+        sum_yy += (int64_t)point.y * point.y;
+    }
+    return orientationFromMoments(double(count * sum_xx - sum_x * sum_x), double(count * sum_xy - sum_x * sum_y),
+                                  double(count * sum_yy - sum_y * sum_y));
+}
+
+/*********************************************** Orientation detection **************************************************
+** Step 1: Check that the contour of the object is large enough to be measured
+** Step 2: Invoke contourOrientation() to get the main axis of the object in closed form from the moments of its contour
+** Step 3: Return the frame to be saved in "orientation" folder if orientation defect is present
+*************************************************************************************************************************/
+
+DefectResult detectOrientation(const Mat &frame, const vector<Point> &contour, Rect object, ObjectOrientation *axis)
+{
+    DefectResult result;
+
+    // The object is reported as defective when its contour is too small to be measured
+    result.defect = true;
+    if (contourArea(contour) >= OBJECT_AREA_MIN)
+    {
+        ObjectOrientation orientation = contourOrientation(contour);
+        if (axis != nullptr)
+            *axis = orientation;
+
+        // If angle is less than 0.5 then we conclude that no orientation defect is present
+        result.defect = !(orientation.angle < 0.5);
+    }
+    if (result.defect)
+        result.image = defectImage(frame);
+    return result;
+}
+
+/*********************************************** Color defect detection **************************************************
+** Step 1: Increase the brightness of the image
+** Step 2: Convert the image to HSV Format.
+**         HSV color space gives more information about the colors of the image. It helps to identify distinct colors in the image.
+** Step 3: Threshold the image based on the color using "inRange" function.
+**         Pass range of the color, which is considered as a defect for the object, as one of the argument to inRange function,
+**         to create a mask
+**         Steps 1 to 3 are run once for all the BGR colors when the program starts, into a ColorTable,
+**         which then classifies every pixel of the object in a single lookup
+** Step 4: Morphological opening and closing is done on the mask to remove noises and fill the gaps
+** Step 5: Find the contours on the mask image. Contours are filtered based on the area to get the contours of defective area.
+**         Contour of the defective area is then drawn on the original image to visualize
+** Step 6: Return the frame to be saved in "color" folder if color defect is present
+*************************************************************************************************************************/
+
+DefectResult detectColor(const Mat &frame, Rect object, bool prefilter)
+{
+    DefectResult result;
+    double area = 0;
+    Scratch &scratch = threadScratch();
+    Mat &img_thresholded = scratch.mask;
+    vector<vector<Point>> &contours = scratch.contours;
+    vector<int> &defective = scratch.defective;
+    defective.clear();
+
+    // Brighten the image, convert it to HSV and threshold it, in a single lookup per pixel
+    ColorTable::colorDefects().classify(frame, img_thresholded);
+
+    // Morphological opening (remove small objects from the foreground)
+    // followed by closing (fill small holes in the foreground)
+    openClose(img_thresholded, img_thresholded);
+    // The area of a contour is at most the one of its bounding rect, so the smaller blobs are never traced
+    if (prefilter)
+        findBlobContours(img_thresholded, 2000, contours);
+    else
+        findContours(img_thresholded, contours, RETR_LIST, CHAIN_APPROX_NONE);
+
+    for (size_t i = 0; i < contours.size(); ++i)
+    {
+        area = contourArea(contours[i]);
+        if (area > 2000 && area < 10000)
+            defective.push_back(i);
+    }
+
+    if (!defective.empty())
+    {
+        result.defect = true;
+        result.image = defectImage(frame);
+        for (size_t i = 0; i < defective.size(); ++i)
+            drawContours(result.image, contours, defective[i], Scalar(0, 0, 255), 2, 8);
+    }
+    return result;
+}
+
+ColorTable::ColorTable(double brightness, Scalar lower, Scalar upper) : bits((1 << 24) / 64)
+{
+    // One plane of 256x256 colors per value of blue, green along the rows and red along the columns
+    Mat plane(256, 256, CV_8UC3), bright, hsv, in_range;
+    for (int b = 0; b < 256; b++)
+    {
+        for (int g = 0; g < 256; g++)
+        {
+            Vec3b *row = plane.ptr<Vec3b>(g);
+            for (int r = 0; r < 256; r++)
+                row[r] = Vec3b(b, g, r);
+        }
+        plane.convertTo(bright, -1, 1, brightness);
+        cvtColor(bright, hsv, COLOR_BGR2HSV);
+        inRange(hsv, lower, upper, in_range);
+
+        uint64_t *word = &bits[(b << 16) / 64];
+        const uchar *in = in_range.ptr<uchar>(0);
+        for (int i = 0; i < 256 * 256; i++)
+            if (in[i])
+                word[i / 64] |= uint64_t(1) << (i % 64);
+    }
+}
+
+void ColorTable::classify(const Mat &frame, Mat &mask) const
+{
+    CV_Assert(frame.type() == CV_8UC3);
+    mask.create(frame.size(), CV_8UC1);
+    const uint64_t *table = bits.data();
+    for (int y = 0; y < frame.rows; y++)
+    {
+        const uchar *pixel = frame.ptr<uchar>(y);
+        uchar *out = mask.ptr<uchar>(y);
+        for (int x = 0; x < frame.cols; x++, pixel += 3)
+        {
+            uint32_t color = (uint32_t(pixel[0]) << 16) | (uint32_t(pixel[1]) << 8) | pixel[2];
+            out[x] = (uchar)(0 - ((table[color >> 6] >> (color & 63)) & 1));
+        }
+    }
+}
+
+const ColorTable &ColorTable::colorDefects()
+{
+    static const ColorTable table(COLOR_BRIGHTNESS, Scalar(COLOR_LOW_H, COLOR_LOW_S, COLOR_LOW_V),
+                                  Scalar(COLOR_HIGH_H, COLOR_HIGH_S, COLOR_HIGH_V));
+    return table;
+}
+
+/**************************************************** Crack detection **************************************************
+** Step 1: Convert the image to gray scale
+** Step 2: Blur the gray image to remove the noises
+** Step 3: Find the edges on the blurred image to get the contours of possible cracks
+** Step 4: Filter the contours to get the contour of the crack
+** Step 5: Draw the contour on the original image for visualization
+** Step 6: Return the frame to be saved in "crack" folder if crack defect is present
+*************************************************************************************************************************/
+
+DefectResult detectCrack(const Mat &frame, Rect object)
+{
+    DefectResult result;
+    double area = 0;
+    Scratch &scratch = threadScratch();
+    Mat &detected_edges = scratch.edges;
+    int low_threshold = 130, kernel_size = 3, ratio = 3;
+    vector<Vec4i> &hierarchy = scratch.hierarchy;
+    vector<vector<Point>> &contours = scratch.contours;
+
+    // Convert the captured frame from BGR to GRAY
+    cvtColor(frame, scratch.gray, COLOR_BGR2GRAY);
+    blur(scratch.gray, scratch.blurred, Size(7, 7));
+
+    // Find the edges
+    Canny(scratch.blurred, detected_edges, low_threshold, low_threshold * ratio, kernel_size);
+
+    // Find the contours
+    findContours(detected_edges, contours, hierarchy, RETR_LIST, CHAIN_APPROX_SIMPLE);
+
+    // The object is free of cracks when there are no edges, or when one of the edges has the size of a crack free outline
+    result.defect = !contours.empty();
+    for (size_t i = 0; i < contours.size(); i++)
+    {
+        area = contourArea(contours[i]);
+        if (area <= 20 && area >= 9)
+        {
+            result.defect = false;
+            break;
+        }
+    }
+
+    // Draw contours
+    if (result.defect)
+    {
+        result.image = defectImage(frame);
+        drawContours(result.image, contours, -1, Scalar(0, 255, 0), 2, 8);
+    }
+    return result;
+}
+
+/************************************************ Masked crack detection ***********************************************
+** Step 1: Fill the contour of the object to get its mask and erode it, so that the outline is not taken for a crack
+** Step 2: Split the bounding rect of the object in tiles. Skip the tiles outside the mask, and in parallel for the others
+**         convert to gray, blur and find the edges, keeping the edges inside the mask
+** Step 3: Score each tile by the density and the number of its edge pixels, which is about the length of the edges
+** Step 4: Trace the edges of the tiles scoring high enough. An edge spanning at least CRACK_MIN_LENGTH pixels is a crack
+** Step 5: Return the frame with the cracks drawn, to be saved in "crack" folder
+*************************************************************************************************************************/
+
+DefectResult detectCrackInMask(const Mat &frame, const vector<Point> &contour, Rect object, Point contour_offset)
+{
+    DefectResult result;
+    Scratch &scratch = threadScratch();
+    Rect region = object & Rect(0, 0, frame.cols, frame.rows);
+    if (region.empty() || contour.empty())
+        return result;
+
+    // Mask of the object in the coordinates of the region, eroded from the outside as well at the sides of the region
+    const Point *points = contour.data();
+    int point_count = contour.size();
+    scratch.filled_mask.create(region.size(), CV_8UC1);
+    scratch.filled_mask.setTo(Scalar(0));
+    fillPoly(scratch.filled_mask, &points, &point_count, 1, Scalar(255), LINE_8, 0, contour_offset - region.tl());
+    erode(scratch.filled_mask, scratch.object_mask, Mat(), Point(-1, -1), CRACK_MASK_EROSION, BORDER_CONSTANT, Scalar(0));
+
+    Mat &edges = scratch.object_edges;
+    edges.create(region.size(), CV_8UC1);
+    edges.setTo(Scalar(0));
+    int tiles_x = (region.width + CRACK_TILE_SIZE - 1) / CRACK_TILE_SIZE;
+    int tiles_y = (region.height + CRACK_TILE_SIZE - 1) / CRACK_TILE_SIZE;
+    vector<TileScore> &tiles = scratch.tiles;
+    tiles.assign(tiles_x * tiles_y, TileScore());
+    const Mat &mask = scratch.object_mask;
+
+    parallel_for_(Range(0, tiles_x * tiles_y), [&](const Range &range)
+    {
+        // Pixels read around a tile: 3 for the 7x7 blur and 1 for the Sobel of Canny
+        const int halo = 4;
+        int low_threshold = 130, kernel_size = 3, ratio = 3;
+        Scratch &tile_scratch = threadScratch();
+
+        for (int index = range.start; index < range.end; index++)
+        {
+            Rect tile = Rect((index % tiles_x) * CRACK_TILE_SIZE, (index / tiles_x) * CRACK_TILE_SIZE, CRACK_TILE_SIZE, CRACK_TILE_SIZE) &
+                        Rect(Point(0, 0), region.size());
+            TileScore &score = tiles[index];
+            score.mask_pixels = countNonZero(mask(tile));
+            if (score.mask_pixels == 0)
+                continue;
+
+            Rect around = Rect(tile.x + region.x - halo, tile.y + region.y - halo, tile.width + 2 * halo, tile.height + 2 * halo) &
+                          Rect(0, 0, frame.cols, frame.rows);
+            cvtColor(frame(around), tile_scratch.tile_gray, COLOR_BGR2GRAY);
+            blur(tile_scratch.tile_gray, tile_scratch.tile_blurred, Size(7, 7));
+            Canny(tile_scratch.tile_blurred, tile_scratch.tile_edges, low_threshold, low_threshold * ratio, kernel_size);
+
+            // Keep the edges of the tile inside the mask
+            Mat kept = edges(tile);
+            tile_scratch.tile_edges(tile + region.tl() - around.tl()).copyTo(kept, mask(tile));
+            score.edge_pixels = countNonZero(kept);
+        }
+    });
+
+    // Only the tiles with enough edges are traced, the others are cleared
+    bool traced = false;
+    for (int index = 0; index < tiles_x * tiles_y; index++)
+    {
+        const TileScore &score = tiles[index];
+        if (score.edge_pixels >= CRACK_TILE_MIN_EDGES && score.edge_pixels >= CRACK_TILE_MIN_DENSITY * score.mask_pixels)
+        {
+            traced = true;
+            continue;
+        }
+        if (score.edge_pixels > 0)
+        {
+            Rect tile = Rect((index % tiles_x) * CRACK_TILE_SIZE, (index / tiles_x) * CRACK_TILE_SIZE, CRACK_TILE_SIZE, CRACK_TILE_SIZE) &
+                        Rect(Point(0, 0), region.size());
+            edges(tile).setTo(Scalar(0));
+        }
+    }
+    if (!traced)
+        return result;
+
+    // The edges are traced over the whole region, so that a crack crossing several tiles stays in one piece
+    vector<vector<Point>> &contours = scratch.contours;
+    vector<int> &cracks = scratch.defective;
+    cracks.clear();
+    findContours(edges, contours, RETR_LIST, CHAIN_APPROX_SIMPLE);
+    for (size_t i = 0; i < contours.size(); i++)
+    {
+        Rect extent = boundingRect(contours[i]);
+        if (max(extent.width, extent.height) >= CRACK_MIN_LENGTH)
+            cracks.push_back(i);
+    }
+
+    if (!cracks.empty())
+    {
+        result.defect = true;
+        result.image = defectImage(frame);
+        for (size_t i = 0; i < cracks.size(); i++)
+            drawContours(result.image, contours, cracks[i], Scalar(0, 255, 0), 2, 8, noArray(), INT_MAX, region.tl());
+    }
+    return result;
+}
+
+/** Calculate euclidean distance between two points **/
+double calculate_distance(Point pts1, Point pts2)
+{
+    double dist;
+
+    double x = pts1.x - pts2.x;
+    double y = pts1.y - pts2.y;
+
+    // Calculating euclidean distance
+    dist = pow(x, 2) + pow(y, 2);
+    dist = sqrt(dist);
+
+    return dist;
+}
+
+// Returns the rounded value
+double round(double value, int place)
+{
+    return floor(value * pow(10, place) + 0.5) / pow(10, place);
+}
+
+// Return the Length and Width of the object
+Vec2f find_dimensions(const vector<Point> &pts, float one_pixel_length)
+{
+    double length, width, length1, width1;
+
+    // Calculate Euclidean ditance
+    length = int(calculate_distance(pts[0], pts[1]));
+    width = int(calculate_distance(pts[1], pts[2]));
+
+    // Rounding the values to two decimal place
+    length1 = round(length * one_pixel_length * 10, 2);
+    width1 = round(width * one_pixel_length * 10, 2);
+
+    if (length1 > width1)
+        return Vec2f(length1, width1);
+    return Vec2f(width1, length1);
+}
+
+Vec2f measureObject(const vector<Point> &contour, float one_pixel_length)
+{
+    Point2f rect_points[4];
+    static thread_local vector<Point> pts;
+
+    pts.clear();
+    minAreaRect(contour).points(rect_points);
+    for (int point = 0; point < 4; point++)
+    {
+        int x = ceil(rect_points[point].x); // Coordinate of x
+        int y = ceil(rect_points[point].y); // Coordinate of y
+        pts.push_back(Point(x, y));
+    }
+    return find_dimensions(pts, one_pixel_length);
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include <chrono>
+# include <cstdio>
+# include <cstring>
+# include "line_protocol.h"
+
+long long influx::now_ns()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void influx::append_escaped(std::string& out, const char* data, size_t size, bool measure)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = data[i];
+        if (c == ',' || c == ' ' || (c == '=' && !measure))
+        {
+            out.append(data + start, i - start);
+            out += '\\';
+            start = i;
+        }
+    }
+    out.append(data + start, size - start);
+}
+
+influx::LineBuilder::LineBuilder(size_t capacity)
+{
+    buffer.reserve(capacity);
+}
+
+void influx::LineBuilder::append_int(long long value)
+{
+    char digits[24];
+    int length = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do
+    {
+        digits[length++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0)
+        buffer += '-';
+    while (length > 0)
+        buffer += digits[--length];
+}
+
+void influx::LineBuilder::begin_field(const char* key)
+{
+    buffer += in_fields ? ',' : ' ';
+    in_fields = true;
+    append_escaped(buffer, key, strlen(key), false);
+    buffer += '=';
+}
+
+influx::LineBuilder& influx::LineBuilder::measure(const char* name)
+{
+    if (lines > 0)
+        buffer += '\n';
+    lines++;
+    in_fields = false;
+    append_escaped(buffer, name, strlen(name), true);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::tag(const char* key, const char* value)
+{
+    buffer += ',';
+    append_escaped(buffer, key, strlen(key), false);
+    buffer += '=';
+    append_escaped(buffer, value, strlen(value), false);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::tag(const char* key, const std::string& value)
+{
+    buffer += ',';
+    append_escaped(buffer, key, strlen(key), false);
+    buffer += '=';
+    append_escaped(buffer, value.data(), value.size(), false);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::tag(const char* key, long long value)
+{
+    buffer += ',';
+    append_escaped(buffer, key, strlen(key), false);
+    buffer += '=';
+    append_int(value);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, int value)
+{
+    return field(key, (long long)value);
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, long value)
+{
+    return field(key, (long long)value);
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, long long value)
+{
+    begin_field(key);
+    append_int(value);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, double value)
+{
+    // Same format as std::to_string(), used by Data. Large magnitudes do not fit in the buffer and are printed again
+    // into one of their size, a truncated value would leave the field empty and the whole batch would be refused
+    char text[64];
+    int length = snprintf(text, sizeof(text), "%f", value);
+    begin_field(key);
+    if (length >= (int)sizeof(text))
+    {
+        size_t start = buffer.size();
+        buffer.resize(start + length + 1);
+        snprintf(&buffer[start], length + 1, "%f", value);
+        buffer.resize(start + length);
+    }
+    else if (length > 0)
+        buffer.append(text, length);
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, const char* value)
+{
+    begin_field(key);
+    buffer += '"';
+    buffer.append(value);
+    buffer += '"';
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::field(const char* key, const std::string& value)
+{
+    begin_field(key);
+    buffer += '"';
+    buffer.append(value);
+    buffer += '"';
+    return *this;
+}
+
+influx::LineBuilder& influx::LineBuilder::timestamp(long long time)
+{
+    buffer += ' ';
+    append_int(time);
+    return *this;
+}
+
+void influx::LineBuilder::clear()
+{
+    buffer.clear();
+    lines = 0;
+    in_fields = false;
+}
@@ -21,17 +21,23 @@
 * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <string>
-#include <iostream>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
 #include <sys/stat.h>
-#include "influxdb.h"
+#include "influx_writer.h"
+#include "detector_cascade.h"
+#include "pipeline.h"
+#include "shm_ring.h"
+#include "stage_stats.h"
 #include <unistd.h>
 #include <nlohmann/json.hpp>
 
@@ -40,349 +46,50 @@ using namespace std;
 using json = nlohmann::json;
 json jsonobj;
 
-#define OBJECT_AREA_MIN 9000
-#define OBJECT_AREA_MAX 50000
-#define MAX_DEFECT_TYPES 3
-
-// Lower and Upper value of color range of the object
-#define LOW_H 0
-#define LOW_S 0
-#define LOW_V 47
-#define HIGH_H 179
-#define HIGH_S 255
-#define HIGH_V 255
-
-int KeyPressed; // Ascii value for the key pressed
-int count_object = 0;
-float one_pixel_length = 0.0;
-char object_count[200];
-char object_height[100]; // Length of the object
-char object_width[100];  // Width of the object
-std::string output_string;
-std::vector<float> measurement;
-
-// Create dataset for PCA Analysis
-Mat createBuffer(const vector<Point> &contour_points)
-{
-    Mat data_points = Mat(contour_points.size(), 2, CV_64FC1);
-    for (int row = 0; row < data_points.rows; row++)
-    {
-        data_points.at<double>(row, 0) = contour_points[row].x;
-        data_points.at<double>(row, 1) = contour_points[row].y;
-    }
-
-    return data_points;
-}
-
-// Get the orientation of the object
-double getOrientation(Mat data_points)
-{
-    // Perform PCA Analysis on the data points
-    PCA pca(data_points, Mat(), PCA::DATA_AS_ROW);
-    Point2d eigen_vector;
-    eigen_vector = Point2d(pca.eigenvectors.at<double>(0, 0),
-                           pca.eigenvectors.at<double>(0, 1));
-
-    // Get the orientation in radians
-    double angle = atan2(eigen_vector.y, eigen_vector.x);
-    return angle;
-}
-
-/*********************************************** Orientation detection **************************************************
-** Step 1: Filter the contours based on the area to get the object of interest
-** Step 2: Invoke getOrientation() and pass the contour of the object as an argument
-**         getOrientation() function performs the PCA analysis
-** Step 3: Save the image of the object in "orientation" folder if orientation defect is present
-*************************************************************************************************************************/
-
-std::vector<std::string> detectOrientation(Mat &frame, const vector<vector<Point>> contours, Rect object)
+/** Length of one pixel of a stream from the field of view of the camera and its distance to the objects **/
+static float pixelLength(VideoCapture &capture, int field, int dist)
 {
-    std::vector<std::string> defects;
-    std::string defect_flag;
-    double area = 0, angle = 0;
-    static int orientation_num = 0;
-    Mat img = frame.clone();
-    for (size_t i = 0; i < contours.size(); ++i)
-    {
-        // Calculate the area of each contour
-        area = contourArea(contours[i]);
-
-        // Ignore contours that are too small to be the object of interest
-        if (area < OBJECT_AREA_MIN)
-            continue;
-
-        Mat data_points = createBuffer(contours[i]);
-
-        // Find the orientation of each contour
-        angle = getOrientation(data_points);
-
-        // If angle is less than 0.5 then we conclude that no orientation defect is present
-        if (angle < 0.5)
-        {
-            // Set defect_flag to true when the object does not contain orientation defect
-            defect_flag = "true";
-        }
-        else
-        {
-            cout << "Orientation defect detected in object " << count_object << endl;
-            output_string = output_string + "Orientation" + " ";
-            sprintf(object_count, "Object Number : %d", count_object);
-            putText(img, object_height, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            putText(img, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            putText(img, object_count, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            putText(img, output_string, Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            orientation_num += 1;
-            imwrite(format("orientation/object_%d.png", count_object), img(Rect(object.tl(), object.br())));
-            imshow("Out", img);
-            KeyPressed = waitKey(2000);
-            if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-                exit(0);
-        }
-        break;
-    }
-    defects.push_back(defect_flag);
-    return defects;
-}
-
-/*********************************************** Color defect detection **************************************************
-** Step 1: Increase the brightness of the image
-** Step 2: Convert the image to HSV Format.
-**         HSV color space gives more information about the colors of the image. It helps to identify distinct colors in the image.
-** Step 3: Threshold the image based on the color using "inRange" function.
-**         Pass range of the color, which is considered as a defect for the object, as one of the argument to inRange function,
-**         to create a mask
-** Step 4: Morphological opening and closing is done on the mask to remove noises and fill the gaps
-** Step 5: Find the contours on the mask image. Contours are filtered based on the area to get the contours of defective area.
-**         Contour of the defective area is then drawn on the original image to visualize
-** Step 6: Save the image of the object in "color" folder if color defect is present
-*************************************************************************************************************************/
-
-std::vector<std::string> detectColor(Mat &frame, Rect object)
-{
-    std::vector<std::string> defects;
-    std::string defect_flag;
-    bool color_flag;
-    double area = 0;
-    static int color_num = 0;
-    Mat imgHSV, img_thresholded, img;
-    vector<Vec4i> hierarchy;
-    vector<vector<Point>> contours;
-
-    img = frame.clone();
-
-    // Increase the brightness of the image
-    frame.convertTo(imgHSV, -1, 1, 20);
-
-    // Convert the captured frame from BGR to HSV
-    cvtColor(imgHSV, imgHSV, COLOR_BGR2HSV);
-
-    // Threshold the image
-    inRange(imgHSV, Scalar(0, 0, 0), Scalar(174, 73, 255), img_thresholded);
-
-    // Morphological opening (remove small objects from the foreground)
-    erode(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-    dilate(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-
-    // Morphological closing (fill small holes in the foreground)
-    dilate(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-    erode(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-    findContours(img_thresholded, contours, hierarchy, RETR_LIST, CHAIN_APPROX_NONE);
-
-    for (size_t i = 0; i < contours.size(); ++i)
-    {
-        area = contourArea(contours[i]);
-        if (area > 2000 && area < 10000)
-        {
-            drawContours(img, contours, i, Scalar(0, 0, 255), 2, 8, hierarchy, 0);
-            sprintf(object_count, "Object Number : %d", count_object);
-           // putText(frame, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            color_num += 1;
-            defect_flag = "false";
-            color_flag = "true";
-        }
-        else if (color_flag != true)
-        {
-            defect_flag = "true";
-        }
-    }
-
-    if (color_flag == true)
-    {
-        output_string = output_string + "Color" + " ";
-        cout << "Color defect detected in object " << count_object << endl;
-        putText(img, object_count, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(img, output_string, Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(img, object_height, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(img, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        imwrite(format("color/object_%d.png", count_object), img(Rect(object.tl(), object.br())));
-        imshow("Out", img);
-        KeyPressed = waitKey(2000);
-        if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-            exit(0);
-    }
-    defects.push_back(defect_flag);
-    return defects;
-}
-
-/**************************************************** Crack detection **************************************************
-** Step 1: Convert the image to gray scale
-** Step 2: Blur the gray image to remove the noises
-** Step 3: Find the edges on the blurred image to get the contours of possible cracks
-** Step 4: Filter the contours to get the contour of the crack
-** Step 5: Draw the contour on the original image for visualization
-** Step 6: Save the image of the object in "crack" folder if crack defect is present
-*************************************************************************************************************************/
-
-std::vector<std::string> detectCrack(Mat &frame, Rect object)
-{
-    std::vector<std::string> defects;
-    std::string defect_flag= "false";
-    char object_count[200];
-    double area = 0;
-    Mat detected_edges, img;
-    static int crack_num = 0;
-    int low_threshold = 130, kernel_size = 3, ratio = 3;
-    vector<Vec4i> hierarchy;
-    vector<vector<Point>> contours;
-
-    // Convert the captured frame from BGR to GRAY
-    cvtColor(frame, img, COLOR_BGR2GRAY);
-    blur(img, img, Size(7, 7));
-
-    // Find the edges
-    Canny(img, detected_edges, low_threshold, low_threshold * ratio, kernel_size);
-
-    // Find the contours
-    findContours(detected_edges, contours, hierarchy, RETR_LIST, CHAIN_APPROX_SIMPLE);
-
-    // Draw contours
-    if (contours.size() != 0)
-    {
-        for (size_t i = 0; i < contours.size(); i++)
-        {
-            area = contourArea(contours[i]);
-            if (area > 20 || area < 9)
-            {
-                sprintf(object_count, "Object Number : %d", count_object);
-                putText(frame, object_height, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                putText(frame, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                putText(frame, object_count, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                drawContours(frame, contours, i, Scalar(0, 255, 0), 2, 8, hierarchy, 0);
-            }
-            else
-            {
-                // Set defect_flag to true when the object does not contain any cracks
-                defect_flag = "true";
-            }
-        }
-        if (defect_flag == "false")
-        {
-            cout << "Crack detected in object " << count_object << endl;
-            output_string = output_string + "Crack" + " ";
-            crack_num += 1;
-            imwrite(format("crack/object_%d.png", count_object), frame(Rect(object.tl(), object.br())));
-            putText(frame, output_string, Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-            imshow("Out", frame);
-            KeyPressed = waitKey(2000);
-            if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-                exit(0);
-        }
-    }
-    else
-    {
-        defect_flag = "true";
-    }
-    defects.push_back(defect_flag);
-    return defects;
-}
-
-/** Write the data to influxDB **/
-int writeToInfluxDB(int count_object, int is_crack_defect, int is_orientation_defect, int is_color_defect)
-{
-    string server_response;
-    influx::InfluxDB db;
-    influx::Data data;
-    data.add_measure("Defect");
-    data.add_field("objectNumber", count_object);
-    data.add_field("crackDefect", is_crack_defect);
-    data.add_field("orientationDefect", is_orientation_defect);
-    data.add_field("colorDefect", is_color_defect);
-    int status = db.write_point("Defect", data);
-
-    return EXIT_SUCCESS;
-}
-
-/** Calculate euclidean distance between two points **/
-double calculate_distance(Point pts1, Point pts2)
-{
-    double dist;
-
-    double x = pts1.x - pts2.x;
-    double y = pts1.y - pts2.y;
-
-    // Calculating euclidean distance
-    dist = pow(x, 2) + pow(y, 2);
-    dist = sqrt(dist);
-
-    return dist;
-}
-
-// Returns the rounded value
-double round(double value, int place)
-{
-    return floor(value * pow(10, place) + 0.5) / pow(10, place);
-}
-
-// Return the Length and Width of the object
-std::vector<float> find_dimensions(vector<cv::Point> pts)
-{
-    std::vector<float> dimension;
-    double length, width, length1, width1;
-    Point tltr, blbr, tlbl, trbr;
-
-    // Calculate Euclidean ditance
-    length = int(calculate_distance(pts[0], pts[1]));
-    width = int(calculate_distance(pts[1], pts[2]));
-
-    // Rounding the values to two decimal place
-    length1 = round(length * one_pixel_length * 10, 2);
-    width1 = round(width * one_pixel_length * 10, 2);
+    int width_of_video = 0, height_of_video = 0;
+    float diagonal_length_of_image_plane = 0.0, diagonal_length_in_pixel = 0.0, radians = 0.0;
+    float one_pixel_length = 0.0;
 
-    if (length1 > width1)
-    {
-        dimension.push_back(length1);
-        dimension.push_back(width1);
-    }
-    else
+    if (field > 0 and dist > 0)
     {
-        dimension.push_back(width1);
-        dimension.push_back(length1);
+        width_of_video = capture.get(3);
+        height_of_video = capture.get(4);
+        // Convert degrees to radians
+        radians = (field / 2) * 0.0174533;
+        //Calculate the diagonal length of image in millimeters using field of view of camera and distance between object and camera.
+        diagonal_length_of_image_plane = (abs(2 * (dist / 10) * tan(radians)));
+        // Calculate diagonal length of image in pixel
+        diagonal_length_in_pixel = sqrt(pow(width_of_video, 2) + pow(height_of_video, 2));
+        // Convert one pixel value in millimeters
+        one_pixel_length = (diagonal_length_of_image_plane / diagonal_length_in_pixel);
     }
-    return dimension;
+    /*  If distance between camera and object and field of view of camera
+        are not provided, then 96 pixels per inch is considered.
+        pixel_lengh = 2.54 cm (1 inch) / 96 pixels */
+    if (one_pixel_length == 0)
+        one_pixel_length = 0.0264583333;
+    return one_pixel_length;
 }
 
 int main(int argc, char *argv[])
 {
-    bool is_orientation_defect, is_color_defect, is_crack_defect;
-    char object_count[200], filepath[50];
+    char filepath[50];
     const char *dir_names[] = {"crack", "color", "orientation", "no_defect"};
-    int frame_count = 0, num_of_dir = 4, status = 0;
-    Mat frame, dst, detected_edges, img_hsv, img_thresholded, frame_color, frame_orientation, frame_crack, frame_nodefect;
-    int width_of_video = 0, height_of_video = 0, opt = 0, field = 0, dist = 0;
-    vector<Vec4i> hierarchy;
-    vector<vector<Point>> contours;
-    std::vector<std::string> orientation_defect, color_defect, crack_defect;
-    float diagonal_length_of_image_plane = 0.0, diagonal_length_in_pixel = 0.0, radians = 0.0;
-
-    measurement.push_back(0.0);
-    measurement.push_back(0.0);
+    int num_of_dir = 4, status = 0;
+    int opt = 0, field = 0, dist = 0, stats_interval_ms = 5000;
+    std::string video, records_path, golden_path;
+    PipelineConfig config;
+    influx::WriterConfig writer_config;
+    ImageWriterConfig image_config;
 
-    Rect object;
     DIR *dir;
     struct dirent *ent;
     struct stat st = {0};
-    string server_response;
-    VideoCapture capture;
+    vector<unique_ptr<VideoCapture>> captures;
+    vector<std::string> stream_names;
     std::string conf_file2 = "resources/config.json";
     std::string conf_file = "../resources/config.json";
     std::ifstream confFile(conf_file);
@@ -398,19 +105,139 @@ int main(int argc, char *argv[])
     }
     else
         confFile>>jsonobj;
+    if (jsonobj.find("headless") != jsonobj.end())
+        config.headless = jsonobj["headless"];
+    if (jsonobj.find("queue_size") != jsonobj.end())
+        config.queue_size = jsonobj["queue_size"];
+    if (jsonobj.find("analysis_threads") != jsonobj.end())
+        config.analysis_threads = jsonobj["analysis_threads"];
+    if (jsonobj.find("roi_detection") != jsonobj.end())
+        config.roi_detection = jsonobj["roi_detection"];
+    if (jsonobj.find("roi_margin") != jsonobj.end())
+        config.roi_margin = jsonobj["roi_margin"];
+    if (jsonobj.find("localization_scale") != jsonobj.end())
+        config.localization_scale = jsonobj["localization_scale"];
+    if (jsonobj.find("blob_prefilter") != jsonobj.end())
+        config.blob_prefilter = jsonobj["blob_prefilter"];
+    if (jsonobj.find("masked_crack_detection") != jsonobj.end())
+        config.masked_crack_detection = jsonobj["masked_crack_detection"];
+    if (jsonobj.find("display_interval") != jsonobj.end())
+        config.display_interval = max(1, jsonobj["display_interval"].get<int>());
+    if (jsonobj.find("stats_interval_ms") != jsonobj.end())
+        stats_interval_ms = jsonobj["stats_interval_ms"];
+    if (jsonobj.find("tracker") != jsonobj.end())
+    {
+        auto tracker = jsonobj["tracker"];
+        config.tracker.enabled = tracker.value("enabled", config.tracker.enabled);
+        config.tracker.axis = tracker.value("axis", std::string(1, config.tracker.axis))[0];
+        config.tracker.line = tracker.value("line", config.tracker.line);
+        config.tracker.max_distance = tracker.value("max_distance", config.tracker.max_distance);
+        config.tracker.max_missed = tracker.value("max_missed", config.tracker.max_missed);
+        config.tracker.jitter = tracker.value("jitter", config.tracker.jitter);
+        config.tracker.receding_frames = tracker.value("receding_frames", config.tracker.receding_frames);
+    }
+    if (jsonobj.find("cascade") != jsonobj.end())
+    {
+        auto cascade = jsonobj["cascade"];
+        config.cascade.enabled = cascade.value("enabled", config.cascade.enabled);
+        config.cascade.order = cascade.value("order", config.cascade.order);
+        config.cascade.adaptive = cascade.value("adaptive", config.cascade.adaptive);
+        config.cascade.audit_every = cascade.value("audit_every", config.cascade.audit_every);
+    }
+    if (jsonobj.find("influx") != jsonobj.end())
+    {
+        auto influx_conf = jsonobj["influx"];
+        writer_config.batch_size = influx_conf.value("batch_size", writer_config.batch_size);
+        writer_config.flush_interval_ms = influx_conf.value("flush_interval_ms", writer_config.flush_interval_ms);
+        writer_config.queue_size = influx_conf.value("queue_size", writer_config.queue_size);
+        writer_config.gzip = influx_conf.value("gzip", writer_config.gzip);
+        writer_config.drop_policy = influx::parse_drop_policy(influx_conf.value("drop_policy", std::string("drop_oldest")));
+        writer_config.spool.path = influx_conf.value("spool_path", writer_config.spool.path);
+        writer_config.spool.max_bytes = (size_t)influx_conf.value("spool_max_mb", (int)(writer_config.spool.max_bytes >> 20)) << 20;
+        writer_config.spool.retry_interval_ms = influx_conf.value("spool_retry_ms", writer_config.spool.retry_interval_ms);
+    }
+    if (jsonobj.find("image_writer") != jsonobj.end())
+    {
+        auto image_conf = jsonobj["image_writer"];
+        image_config.threads = image_conf.value("threads", image_config.threads);
+        image_config.queue_size = image_conf.value("queue_size", image_config.queue_size);
+        image_config.format = parse_image_format(image_conf.value("format", std::string("png")));
+        image_config.png_compression = image_conf.value("png_compression", image_config.png_compression);
+        image_config.jpeg_quality = image_conf.value("jpeg_quality", image_config.jpeg_quality);
+        if (image_conf.find("save_every") != image_conf.end())
+            image_config.save_every = image_conf["save_every"].get<std::map<std::string, int>>();
+        image_config.archive = image_conf.value("archive", image_config.archive);
+        image_config.archive_segment_mb = image_conf.value("archive_segment_mb", image_config.archive_segment_mb);
+    }
+    // Parsing Command Line arguments
+    while ((opt = getopt(argc, argv, ":f:d:i:nv:r:g:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            config.headless = true;
+            break;
+        case 'f':
+            field = atoi(optarg);
+            break;
+        case 'd':
+            dist = atoi(optarg);
+            break;
+        case 'v':
+            video = optarg;
+            break;
+        case 'r':
+            records_path = optarg;
+            break;
+        case 'g':
+            golden_path = optarg;
+            break;
+        }
+    }
+    // Replay mode: no display, no pacing and no InfluxDB, one record per object. Every check runs on every object,
+    // so that the records do not depend on the order the cascade has learnt
+    bool replay = !records_path.empty() || !golden_path.empty();
+    if (replay)
+    {
+        config.headless = true;
+        config.cascade.enabled = false;
+    }
+
     auto obj = jsonobj["inputs"];
-    std::string input = obj[0]["video"];
-    if (input.size() == 1 && *(input.c_str()) >= '0' && *(input.c_str()) <= '9')
+    if (!video.empty())
+        obj = json::array({json{{"video", video}}});
+    if (obj.empty())
     {
-        capture.open(std::stoi(input));
+        cout << "No input in the config file" << endl;
+        return 2;
     }
-    else
+    // Every input gets its own capture and pipeline
+    for (size_t num = 0; num < obj.size(); num++)
     {
-        capture.open(input);
+        std::string input = obj[num]["video"];
+        if (input.compare(0, strlen(SHM_INPUT_PREFIX), SHM_INPUT_PREFIX) == 0)
+        {
+            // Frames published by another process into a shared memory ring
+            ShmCapture *ring = new ShmCapture(input.substr(strlen(SHM_INPUT_PREFIX)));
+            captures.emplace_back(ring);
+            if (ring->isOpened() && ring->slots() < (int)config.queue_size + 2)
+                cout << "WARNING:: The ring " << input << " holds " << ring->slots() << " frames, fewer than the "
+                     << config.queue_size + 2 << " the queues can take, the capture waits for the segmentation" << endl;
+        }
+        else if (input.size() == 1 && *(input.c_str()) >= '0' && *(input.c_str()) <= '9')
+        {
+            captures.emplace_back(new VideoCapture(std::stoi(input)));
+        }
+        else
+        {
+            captures.emplace_back(new VideoCapture(input));
+        }
+        // The streams are named only when there are several of them
+        stream_names.push_back(obj[num].value("name", obj.size() > 1 ? std::to_string(num) : std::string()));
     }
 
-    // Create directories to save images of objects
-    for (int num = 0; num < num_of_dir; num++)
+    // Create directories to save images of objects, not needed when they go to an archive
+    for (int num = 0; num < num_of_dir && image_config.archive.empty(); num++)
     {
         // Check if the directory exists, clean the directory if it does
         if (stat(dir_names[num], &st) == 0)
@@ -444,187 +271,170 @@ int main(int argc, char *argv[])
         }
     }
 
-    // Parsing Command Line arguments
-    while ((opt = getopt(argc, argv, ":f:d:i:")) != -1)
+    // Check if the videos are loaded successfully
+    for (size_t num = 0; num < captures.size(); num++)
     {
-        switch (opt)
+        if (!captures[num]->isOpened())
         {
-        case 'f':
-            field = atoi(optarg);
-            break;
-        case 'd':
-            dist = atoi(optarg);
-            break;
+            cout << "Problem loading the video " << obj[num]["video"].get<std::string>() << "!!!" << endl;
+            return EXIT_FAILURE;
         }
     }
 
-    if (field > 0 and dist > 0)
+    // Create the database in influxDB named "Defect". The same client writes all the defects, in batches from a background thread
+    unique_ptr<influx::InfluxDB> db;
+    unique_ptr<influx::AsyncWriter> writer;
+    unique_ptr<StatsReporter> stats;
+    unique_ptr<ObjectRecorder> recorder;
+    if (!replay)
     {
-        width_of_video = capture.get(3);
-        height_of_video = capture.get(4);
-        // Convert degrees to radians
-        radians = (field / 2) * 0.0174533;
-        //Calculate the diagonal length of image in millimeters using field of view of camera and distance between object and camera.
-        diagonal_length_of_image_plane = (abs(2 * (dist / 10) * tan(radians)));
-        // Calculate diagonal length of image in pixel
-        diagonal_length_in_pixel = sqrt(pow(width_of_video, 2) + pow(height_of_video, 2));
-        // Convert one pixel value in millimeters
-        one_pixel_length = (diagonal_length_of_image_plane / diagonal_length_in_pixel);
-    }
-    /*  If distance between camera and object and field of view of camera
-        are not provided, then 96 pixels per inch is considered.
-        pixel_lengh = 2.54 cm (1 inch) / 96 pixels */
-    if (one_pixel_length == 0)
-        one_pixel_length = 0.0264583333;
+        db.reset(new influx::InfluxDB());
+        db->create_database("Defect");
+        writer.reset(new influx::AsyncWriter(*db, "Defect", writer_config));
 
-    // Check if video is loaded successfully
-    if (!capture.isOpened())
+        // Publish the latencies of the stages as the PipelineStats measurement, 0 turns the timing off
+        if (stats_interval_ms > 0)
+            stats.reset(new StatsReporter(*writer, stats_interval_ms));
+    }
+    else
     {
-        cout << "Problem loading the video!!!" << endl;
-        return EXIT_FAILURE;
+        // The latencies are only reported at the end of the replay
+        enableLatencies(true);
+        recorder.reset(new ObjectRecorder(records_path));
     }
 
-    // Create the database in influxDB named "Defect"
-    influx::InfluxDB db;
-    db.create_database("Defect");
+    // The images of the objects are encoded and saved by their own threads
+    ImageWriter images(image_config);
 
-    sprintf(object_count, "Object Number : %d", count_object);
-    for (;;)
+    // Run capture, segmentation, defect analysis and output of every stream on separate threads.
+    // The detectors of all the streams share one pool of workers
+    ThreadPool pool(config.analysis_threads);
+    vector<unique_ptr<Pipeline>> pipelines;
+    vector<Pipeline*> running;
+    for (size_t num = 0; num < captures.size(); num++)
     {
-        Rect maxArea = Rect(Point(0, 0), Point(1, 1));
-
-        // Read the frame from the stream
-        capture >> frame;
-
-        if (frame.empty())
+        PipelineConfig stream_config = config;
+        stream_config.stream = stream_names[num];
+        stream_config.one_pixel_length = pixelLength(*captures[num], field, dist);
+        pipelines.emplace_back(new Pipeline(*captures[num], stream_config, pool, writer.get(), images, recorder.get()));
+        running.push_back(pipelines.back().get());
+    }
+    auto start_time = chrono::steady_clock::now();
+    for (auto &pipeline : pipelines)
+        pipeline->start();
+    bool completed = Pipeline::display(running);
+    for (auto &pipeline : pipelines)
+        pipeline->join();
+    images.close();
+    if (stats)
+        stats->close();
+    if (writer)
+        writer->close();
+    if (recorder)
+        recorder->close();
+    if (!completed)
+        exit(0);
+
+    // Report the achieved throughput
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    long total_frames = 0, total_objects = 0, total_decoded = 0, total_skipped = 0;
+    for (size_t num = 0; num < pipelines.size(); num++)
+    {
+        total_frames += pipelines[num]->frames_read();
+        total_objects += pipelines[num]->objects_found();
+        total_decoded += pipelines[num]->frames_decoded();
+        total_skipped += pipelines[num]->frames_skipped();
+        if (pipelines.size() > 1)
+            cout << "Stream " << stream_names[num] << ": " << pipelines[num]->frames_read() << " frames ("
+                 << pipelines[num]->frames_decoded() << " decoded, " << pipelines[num]->frames_skipped() << " skipped), "
+                 << pipelines[num]->objects_found() << " objects" << endl;
+    }
+    cout << "Frames decoded: " << total_decoded << ", skipped without decoding: " << total_skipped << endl;
+    if (elapsed > 0)
+    {
+        cout << "Processed " << total_frames << " frames and " << total_objects << " objects in " << elapsed << " s" << endl;
+        cout << "Frames per second  : " << total_frames / elapsed << endl;
+        cout << "Objects per second : " << total_objects / elapsed << endl;
+    }
+    for (size_t num = 0; num < pipelines.size(); num++)
+    {
+        const DetectorCascade &cascade = pipelines[num]->detector_cascade();
+        if (!cascade.enabled() || cascade.objects() == 0)
+            continue;
+        cout << "Detector cascade" << (pipelines.size() > 1 ? " of stream " + stream_names[num] : string()) << ": order "
+             << cascade.order_text() << " after " << cascade.reorders() << " reorders, " << cascade.stopped_early()
+             << " of " << cascade.objects() << " objects stopped at a defect, " << cascade.audited() << " audited, "
+             << cascade.saved_ms() << " ms of detector time saved" << endl;
+        cout << "  detector          runs   defects   mean (ms)" << endl;
+        for (Detector detector : cascade.order())
         {
-            cout << "Video stream ended" << endl;
-            break;
+            const DetectorStats &stats = cascade.detector_stats(detector);
+            printf("  %-12s %9lu %9lu %11.3f\n", detector_name(detector), (unsigned long)stats.runs,
+                   (unsigned long)stats.hits, stats.mean_ns() / 1e6);
         }
-        frame_count++;
-
-        // Check every 40th frame (Number chosen based on the frequency of object on conveyor belt)
-        if (frame_count % 40 == 0)
+    }
+    if (writer)
+        cout << "InfluxDB points written: " << writer->written_points() << ", failed: " << writer->failed_points()
+             << ", dropped: " << writer->dropped_points() << " in " << writer->sent_batches() << " batches" << endl;
+    cout << "Images saved: " << images.saved_images() << ", skipped by sampling: " << images.skipped_images()
+         << ", dropped: " << images.dropped_images() << ", failed: " << images.failed_images() << endl;
+    if (stats)
+    {
+        cout << "Latency of the stages (ms): calls, median, 99th percentile, max" << endl;
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
         {
-            measurement[0] = 0;
-            measurement[1] = 0;
-            is_orientation_defect = true;
-            is_color_defect = true;
-            is_crack_defect = true;
-
-            // Convert RGB image to HSV color space
-            cvtColor(frame, img_hsv, COLOR_RGB2HSV);
-
-            // Thresholding of an Image in a color range
-            inRange(img_hsv, Scalar(LOW_H, LOW_S, LOW_V), Scalar(HIGH_H, HIGH_S, HIGH_V), img_thresholded);
-
-            // Morphological opening (remove small objects from the foreground)
-            erode(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-            dilate(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-
-            // Morphological closing (fill small holes in the foreground)
-            dilate(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-            erode(img_thresholded, img_thresholded, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
+            const LatencyHistogram &latency = stats->total((Stage)stage);
+            if (latency.count() > 0)
+                printf("  %-14s %8lu %10.3f %10.3f %10.3f\n", stage_name((Stage)stage), (unsigned long)latency.count(),
+                       latency.percentile(0.5) / 1e6, latency.percentile(0.99) / 1e6, latency.max() / 1e6);
+        }
+    }
+#ifdef COUNT_ALLOCATIONS
+    cout << "Heap allocations of the stages: calls, allocations per call, calls without any allocation" << endl;
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        AllocationCount count = stageAllocations((Stage)stage);
+        if (count.calls > 0)
+            printf("  %-14s %8lu %10.2f %9.1f%%\n", stage_name((Stage)stage), (unsigned long)count.calls,
+                   double(count.allocations) / count.calls, 100.0 * count.allocation_free_calls / count.calls);
+    }
+#endif
+    if (writer && writer->get_spool() != nullptr)
+        cout << "InfluxDB points spooled: " << writer->spooled_points() << ", replayed: " << writer->get_spool()->replayed_points()
+             << ", still pending: " << writer->get_spool()->pending_points() << ", dropped: " << writer->get_spool()->dropped_points() << endl;
 
-            // Find the contours on the image
-            findContours(img_thresholded, contours, hierarchy, RETR_LIST, CHAIN_APPROX_NONE);
-            vector<RotatedRect> minRect(contours.size());
+    if (replay)
+    {
+        // Time spent in each step, summed over all the threads, so the detectors running in parallel can add up to more than the wall time
+        LatencyHistogram latencies[STAGE_COUNT];
+        collectLatencies(latencies);
+        cout << "Time per step: calls, total (s), share of the wall time, mean (ms)" << endl;
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            double total = latencies[stage].mean() * latencies[stage].count() / 1e9;
+            if (latencies[stage].count() > 0)
+                printf("  %-14s %8lu %10.3f %9.1f%% %10.3f\n", stage_name((Stage)stage), (unsigned long)latencies[stage].count(),
+                       total, elapsed > 0 ? 100 * total / elapsed : 0, latencies[stage].mean() / 1e6);
+        }
+        if (!records_path.empty())
+            cout << recorder->records().size() << " records written to " << records_path << endl;
 
-            // Find the contour with maximum area
-            for (size_t contour = 0; contour < contours.size(); contour++)
+        if (!golden_path.empty())
+        {
+            vector<ObjectRecord> golden;
+            if (!loadRecords(golden_path, golden))
             {
-                object = boundingRect(contours[contour]);
-                Point2f rect_points[4];
-                std::vector<cv::Point> pts;
-                if (object.width * object.height > OBJECT_AREA_MIN && OBJECT_AREA_MAX > object.width * object.height)
-                {
-                    minRect[contour] = minAreaRect(contours[contour]);
-
-                    minRect[contour].points(rect_points);
-                    for (int point = 0; point < 4; point++)
-                    {
-                        int x = ceil(rect_points[point].x); // Coordinate of x
-                        int y = ceil(rect_points[point].y); // Coordinate of y
-                        pts.push_back(Point(x, y));
-                    }
-
-                    measurement = find_dimensions(pts);
-                    sprintf(object_height, "Length (mm) = %.2f", measurement[0]);
-                    sprintf(object_width,  "Width (mm)  = %.2f", measurement[1]);
-                    frame_crack = frame.clone();
-                    frame_orientation = frame.clone();
-                    frame_color = frame.clone();
-                    frame_nodefect = frame.clone();
-
-                    // Save only the object instead of the complete frame
-                    count_object++;
-                    sprintf(object_count, "Object Number : %d", count_object);
-
-                    // Check the occurence of defects in object, if the function returns true, corresponding defect is not present in the object
-                    output_string.clear();
-                    output_string = "Defect : ";
-
-                    orientation_defect = detectOrientation(frame_orientation, contours, object);
-                    if (strncmp(orientation_defect[0].c_str(), "true", 4) == 0)
-                    {
-                        is_orientation_defect = false;
-                    }
-
-                    color_defect = detectColor(frame_color, object);
-                    if (strncmp(color_defect[0].c_str(), "true", 4) == 0)
-                    {
-                        is_color_defect = false;
-                    }
-
-                    crack_defect = detectCrack(frame_crack, object);
-                    if (strcmp(crack_defect[0].c_str(), "true") == 0)
-                    {
-                        is_crack_defect = false;
-                    }
-
-                    // Display and save the object with no defect
-                    if (is_orientation_defect == false && is_color_defect == false && is_crack_defect == false)
-                    {
-                        output_string = output_string + "No Defect" + " ";
-                        cout << "No defect detected in object " << count_object << endl;
-                        sprintf(object_count, "Object Number : %d", count_object);
-                        putText(frame_nodefect, object_height, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                        putText(frame_nodefect, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                        putText(frame_nodefect, object_count, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                        putText(frame_nodefect, output_string, Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-                        imwrite(format("no_defect/object_%d.png", count_object), frame(Rect(object.tl(), object.br())));
-                        imshow("Out", frame_nodefect);
-                        KeyPressed = waitKey(2000);
-                        if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-                            exit(0);
-                    }
-
-                    status = writeToInfluxDB(count_object, is_crack_defect, is_orientation_defect, is_color_defect);
-                    if (status == EXIT_FAILURE)
-                    {
-                        return EXIT_FAILURE;
-                    }
-                    cout << object_height << " " << object_width << endl;
-                    KeyPressed = waitKey(25);
-                    if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-                        exit(0);
-                }
+                cout << "Could not read the golden file " << golden_path << endl;
+                return EXIT_FAILURE;
             }
+            int differences = compareRecords(golden, recorder->records());
+            if (differences > 0)
+            {
+                cout << differences << " of " << golden.size() << " objects differ from " << golden_path << endl;
+                return EXIT_FAILURE;
+            }
+            cout << "All " << golden.size() << " objects match " << golden_path << endl;
         }
-        sprintf(object_height, "Length (mm) = %.2f", measurement[0]);
-        sprintf(object_width, "Width (mm)  = %.2f", measurement[1]);
-        putText(frame, "Press q to quit", Point(410, 50), FONT_HERSHEY_DUPLEX, 1, Scalar(255, 255, 255), 2);
-        putText(frame, object_count, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(frame, object_height, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(frame, object_width, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        putText(frame, "Defect : ", Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
-        imshow("Out", frame);
-        KeyPressed = waitKey(25);
-        if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
-            exit(0);
-        hierarchy.clear();
-        contours.clear();
     }
     return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "morphology.h"
+
+using namespace cv;
+using namespace std;
+
+// Rows of the mask filtered per strip. 64 rows of a 1080p mask, with their halo, take about 20 KB once packed
+#define STRIP_ROWS 64
+
+// Rows needed above and below a strip: 2 for each of the 4 steps
+#define STRIP_HALO 8
+
+const Mat &ellipseKernel()
+{
+    static const Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(5, 5));
+    return kernel;
+}
+
+void openCloseReference(const Mat &src, Mat &dst)
+{
+    // Morphological opening (remove small objects from the foreground)
+    erode(src, dst, ellipseKernel());
+    dilate(dst, dst, ellipseKernel());
+
+    // Morphological closing (fill small holes in the foreground)
+    dilate(dst, dst, ellipseKernel());
+    erode(dst, dst, ellipseKernel());
+}
+
+/*
+ * The 5x5 ellipse is
+ *
+ *     . . x . .
+ *     x x x x x
+ *     x x x x x
+ *     x x x x x
+ *     . . x . .
+ *
+ * so an erosion is the AND of the 5 pixel wide run on the rows y-1, y and y+1,
+ * and of the single pixel on the rows y-2 and y+2. A dilation is the same with OR.
+ * Like in OpenCV, pixels outside of the mask do not take part: they count as set
+ * for an erosion and as clear for a dilation.
+ */
+
+// Packed rows of a strip, the row y of the mask being at (y - base) * words
+struct Strip
+{
+    uint64_t *bits;
+    int base;
+    int words;
+
+    uint64_t *row(int y) const { return bits + (size_t)(y - base) * words; }
+};
+
+// Run of 5 pixels centred on every bit of the word, prev and next being the words on its left and right
+template <bool Erode>
+static inline uint64_t horizontalRun(uint64_t prev, uint64_t word, uint64_t next)
+{
+    uint64_t left1 = (word << 1) | (prev >> 63);
+    uint64_t left2 = (word << 2) | (prev >> 62);
+    uint64_t right1 = (word >> 1) | (next << 63);
+    uint64_t right2 = (word >> 2) | (next << 62);
+    if (Erode)
+        return word & left1 & left2 & right1 & right2;
+    return word | left1 | left2 | right1 | right2;
+}
+
+// One erosion or dilation of the rows [out_begin, out_end), reading the rows [in_begin, in_end)
+template <bool Erode>
+static void morphStep(const Strip &in, const Strip &runs, const Strip &out, int width, int rows,
+                      int in_begin, int in_end, int out_begin, int out_end)
+{
+    const uint64_t neutral = Erode ? ~uint64_t(0) : 0;
+    const int words = in.words;
+    const int tail_bits = width % 64;
+
+    // Pixels past the right edge of the mask must not take part
+    if (tail_bits != 0)
+    {
+        const uint64_t tail_mask = (uint64_t(1) << tail_bits) - 1;
+        for (int y = in_begin; y < in_end; y++)
+        {
+            uint64_t *last = in.row(y) + words - 1;
+            *last = Erode ? (*last | ~tail_mask) : (*last & tail_mask);
+        }
+    }
+
+    // Horizontal runs of the rows the vertical step reads
+    int runs_begin = max(in_begin, out_begin - 1), runs_end = min(in_end, out_end + 1);
+    for (int y = runs_begin; y < runs_end; y++)
+    {
+        const uint64_t *src = in.row(y);
+        uint64_t *dst = runs.row(y);
+        if (words == 1)
+        {
+            dst[0] = horizontalRun<Erode>(neutral, src[0], neutral);
+            continue;
+        }
+        dst[0] = horizontalRun<Erode>(neutral, src[0], src[1]);
+        for (int w = 1; w < words - 1; w++)
+            dst[w] = horizontalRun<Erode>(src[w - 1], src[w], src[w + 1]);
+        dst[words - 1] = horizontalRun<Erode>(src[words - 2], src[words - 1], neutral);
+    }
+
+    // Vertical step, rows outside of the mask are skipped
+    for (int y = out_begin; y < out_end; y++)
+    {
+        uint64_t *dst = out.row(y);
+        const uint64_t *middle = runs.row(y);
+        for (int w = 0; w < words; w++)
+            dst[w] = middle[w];
+        const uint64_t *sources[4] = {
+            y - 1 >= 0 ? runs.row(y - 1) : nullptr,
+            y + 1 < rows ? runs.row(y + 1) : nullptr,
+            y - 2 >= 0 ? in.row(y - 2) : nullptr,
+            y + 2 < rows ? in.row(y + 2) : nullptr};
+        for (int s = 0; s < 4; s++)
+        {
+            const uint64_t *src = sources[s];
+            if (src == nullptr)
+                continue;
+            if (Erode)
+                for (int w = 0; w < words; w++)
+                    dst[w] &= src[w];
+            else
+                for (int w = 0; w < words; w++)
+                    dst[w] |= src[w];
+        }
+    }
+}
+
+void openClose(const Mat &src, Mat &dst)
+{
+    CV_Assert(src.type() == CV_8UC1);
+    const int rows = src.rows, cols = src.cols;
+    const int words = (cols + 63) / 64;
+    const int strip_capacity = STRIP_ROWS + 2 * STRIP_HALO;
+
+    // Buffers are kept per thread and reused from call to call
+    static thread_local vector<uint64_t> packed, buffer_a, buffer_b, buffer_runs;
+    packed.resize((size_t)rows * words);
+    buffer_a.resize((size_t)strip_capacity * words);
+    buffer_b.resize((size_t)strip_capacity * words);
+    buffer_runs.resize((size_t)strip_capacity * words);
+
+    // Pack the mask to one bit per pixel. Reading it all first lets dst be the same as src
+    for (int y = 0; y < rows; y++)
+    {
+        const uchar *pixels = src.ptr<uchar>(y);
+        uint64_t *bits = &packed[(size_t)y * words];
+        for (int w = 0; w < words; w++)
+        {
+            const uchar *run = pixels + w * 64;
+            int count = min(64, cols - w * 64);
+            uint64_t word = 0;
+            for (int x = 0; x < count; x++)
+                word |= uint64_t(run[x] != 0) << x;
+            bits[w] = word;
+        }
+    }
+
+    dst.create(rows, cols, CV_8UC1);
+    for (int top = 0; top < rows; top += STRIP_ROWS)
+    {
+        int bottom = min(top + STRIP_ROWS, rows);
+        int begin = max(0, top - STRIP_HALO), end = min(rows, bottom + STRIP_HALO);
+        Strip a = {buffer_a.data(), begin, words};
+        Strip b = {buffer_b.data(), begin, words};
+        Strip runs = {buffer_runs.data(), begin, words};
+        memcpy(a.bits, &packed[(size_t)begin * words], (size_t)(end - begin) * words * sizeof(uint64_t));
+
+        // Each step loses 2 rows at either end of the strip, except at the edges of the mask
+        int in_begin = begin, in_end = end;
+        for (int step = 0; step < 4; step++)
+        {
+            int out_begin = in_begin == 0 ? 0 : in_begin + 2;
+            int out_end = in_end == rows ? rows : in_end - 2;
+            // Opening: erode, dilate. Closing: dilate, erode
+            if (step == 0 || step == 3)
+                morphStep<true>(a, runs, b, cols, rows, in_begin, in_end, out_begin, out_end);
+            else
+                morphStep<false>(a, runs, b, cols, rows, in_begin, in_end, out_begin, out_end);
+            swap(a, b);
+            in_begin = out_begin;
+            in_end = out_end;
+        }
+
+        // Unpack the rows of the strip
+        for (int y = top; y < bottom; y++)
+        {
+            const uint64_t *bits = a.row(y);
+            uchar *pixels = dst.ptr<uchar>(y);
+            for (int w = 0; w < words; w++)
+            {
+                uchar *run = pixels + w * 64;
+                int count = min(64, cols - w * 64);
+                uint64_t word = bits[w];
+                for (int x = 0; x < count; x++)
+                    run[x] = (uchar)(0 - ((word >> x) & 1));
+            }
+        }
+    }
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include "object_records.h"
+
+using namespace cv;
+using namespace std;
+using json = nlohmann::json;
+
+static const char CSV_HEADER[] = "stream,object,frame,x,y,width,height,length_mm,width_mm,orientation,color,crack,angle,eccentricity,complete";
+static const int MAX_REPORTED_DIFFERENCES = 20;
+
+static bool endsWith(const string &text, const string &suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Quote a CSV value holding a separator or a quote
+static string csvValue(const string &value)
+{
+    if (value.find_first_of(",\"\n") == string::npos)
+        return value;
+    string quoted = "\"";
+    for (char c : value)
+        quoted += c == '"' ? "\"\"" : string(1, c);
+    return quoted + "\"";
+}
+
+// Split a CSV line into its values, handling the quoted ones
+static vector<string> csvValues(const string &line)
+{
+    vector<string> values(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        char c = line[i];
+        if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+            values.back() += line[++i];
+        else if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+            values.emplace_back();
+        else
+            values.back() += c;
+    }
+    return values;
+}
+
+ObjectRecorder::ObjectRecorder(const string &path)
+{
+    if (path.empty())
+        return;
+    csv = endsWith(path, ".csv");
+    file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        cout << "Could not open " << path << " to write the records" << endl;
+        return;
+    }
+    if (csv)
+        fprintf(file, "%s\n", CSV_HEADER);
+}
+
+ObjectRecorder::~ObjectRecorder()
+{
+    close();
+}
+
+void ObjectRecorder::record(const string &stream, const InspectionResult &result)
+{
+    ObjectRecord record;
+    const ObjectSample &sample = result.sample;
+    record.stream = stream;
+    record.number = sample.number;
+    record.frame = sample.frame_index;
+    record.object = sample.object;
+    record.length = sample.measurement[0];
+    record.width = sample.measurement[1];
+    record.orientation = result.orientation.defect;
+    record.color = result.color.defect;
+    record.crack = result.crack.defect;
+    record.complete = result.complete;
+    record.angle = result.axis.angle;
+    record.eccentricity = result.axis.eccentricity;
+
+    lock_guard<mutex> guard(lock);
+    recorded.push_back(record);
+    if (file == nullptr)
+        return;
+    if (csv)
+        fprintf(file, "%s,%d,%ld,%d,%d,%d,%d,%.2f,%.2f,%d,%d,%d,%.4f,%.4f,%d\n", csvValue(record.stream).c_str(), record.number, record.frame,
+                record.object.x, record.object.y, record.object.width, record.object.height, record.length, record.width,
+                record.orientation, record.color, record.crack, record.angle, record.eccentricity, record.complete);
+    else
+        fprintf(file, "{\"stream\":%s,\"object\":%d,\"frame\":%ld,\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,"
+                "\"length_mm\":%.2f,\"width_mm\":%.2f,\"orientation\":%d,\"color\":%d,\"crack\":%d,"
+                "\"angle\":%.4f,\"eccentricity\":%.4f,\"complete\":%d}\n",
+                json(record.stream).dump().c_str(), record.number, record.frame, record.object.x, record.object.y,
+                record.object.width, record.object.height, record.length, record.width,
+                record.orientation, record.color, record.crack, record.angle, record.eccentricity, record.complete);
+}
+
+void ObjectRecorder::close()
+{
+    lock_guard<mutex> guard(lock);
+    if (file != nullptr)
+        fclose(file);
+    file = nullptr;
+}
+
+bool loadRecords(const string &path, vector<ObjectRecord> &records)
+{
+    ifstream file(path);
+    string line;
+    bool csv = endsWith(path, ".csv");
+
+    if (!file.is_open())
+        return false;
+    if (csv && !getline(file, line))
+        return false;
+    while (getline(file, line))
+    {
+        if (line.empty())
+            continue;
+        ObjectRecord record;
+        try
+        {
+            if (csv)
+            {
+                vector<string> values = csvValues(line);
+                if (values.size() < 12)
+                    return false;
+                record.stream = values[0];
+                record.number = stoi(values[1]);
+                record.frame = stol(values[2]);
+                record.object = Rect(stoi(values[3]), stoi(values[4]), stoi(values[5]), stoi(values[6]));
+                record.length = stof(values[7]);
+                record.width = stof(values[8]);
+                record.orientation = stoi(values[9]) != 0;
+                record.color = stoi(values[10]) != 0;
+                record.crack = stoi(values[11]) != 0;
+                // Records written before the angle was recorded have no axis
+                if (values.size() >= 14)
+                {
+                    record.angle = stod(values[12]);
+                    record.eccentricity = stod(values[13]);
+                }
+                // and the ones written before the cascade have no complete flag, all their checks ran
+                if (values.size() >= 15)
+                    record.complete = stoi(values[14]) != 0;
+            }
+            else
+            {
+                json values = json::parse(line);
+                record.stream = values.value("stream", string());
+                record.number = values.at("object").get<int>();
+                record.frame = values.at("frame").get<long>();
+                record.object = Rect(values.at("x").get<int>(), values.at("y").get<int>(),
+                                     values.at("width").get<int>(), values.at("height").get<int>());
+                record.length = values.at("length_mm").get<float>();
+                record.width = values.at("width_mm").get<float>();
+                record.orientation = values.at("orientation").get<int>() != 0;
+                record.color = values.at("color").get<int>() != 0;
+                record.crack = values.at("crack").get<int>() != 0;
+                record.angle = values.value("angle", 0.0);
+                record.eccentricity = values.value("eccentricity", 0.0);
+                record.complete = values.value("complete", 1) != 0;
+            }
+        }
+        catch (const exception &e)
+        {
+            cout << "Invalid record in " << path << ": " << line << endl;
+            return false;
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+static string describe(const ObjectRecord &record)
+{
+    char text[200];
+    snprintf(text, sizeof(text), "frame %ld rect %dx%d+%d+%d size %.2fx%.2f mm defects %s%s%s%s", record.frame,
+             record.object.width, record.object.height, record.object.x, record.object.y, record.length, record.width,
+             record.orientation ? "O" : "-", record.color ? "C" : "-", record.crack ? "K" : "-", record.complete ? "" : " (partial)");
+    return text;
+}
+
+static string objectName(const ObjectRecord &record)
+{
+    return (record.stream.empty() ? "" : record.stream + "/") + to_string(record.number);
+}
+
+int compareRecords(const vector<ObjectRecord> &golden, const vector<ObjectRecord> &records)
+{
+    map<pair<string, int>, const ObjectRecord*> expected;
+    int differences = 0;
+
+    auto report = [&differences](const string &text)
+    {
+        if (differences++ < MAX_REPORTED_DIFFERENCES)
+            cout << "  " << text << endl;
+    };
+
+    for (const auto &record : golden)
+        expected[make_pair(record.stream, record.number)] = &record;
+    for (const auto &record : records)
+    {
+        auto match = expected.find(make_pair(record.stream, record.number));
+        if (match == expected.end())
+        {
+            report("object " + objectName(record) + " not in the golden file: " + describe(record));
+            continue;
+        }
+        const ObjectRecord &reference = *match->second;
+        if (reference.frame != record.frame || reference.object != record.object ||
+            fabs(reference.length - record.length) > 0.011 || fabs(reference.width - record.width) > 0.011 ||
+            reference.orientation != record.orientation || reference.color != record.color || reference.crack != record.crack ||
+            reference.complete != record.complete)
+            report("object " + objectName(record) + " differs: expected " + describe(reference) + ", got " + describe(record));
+        expected.erase(match);
+    }
+    for (const auto &missing : expected)
+        report("object " + objectName(*missing.second) + " missing: " + describe(*missing.second));
+    if (differences > MAX_REPORTED_DIFFERENCES)
+        cout << "  ... and " << differences - MAX_REPORTED_DIFFERENCES << " more" << endl;
+    return differences;
+}
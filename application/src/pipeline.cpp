@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "buffer_pool.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+
+using namespace cv;
+using namespace std;
+
+/** Queue the data to be written to influxDB **/
+static int writeToInfluxDB(influx::AsyncWriter &writer, influx::LineBuilder &point, const string &stream, int count_object, int is_crack_defect, int is_orientation_defect, int is_color_defect, int is_complete)
+{
+    point.clear();
+    point.measure("Defect");
+    if (!stream.empty())
+        point.tag("stream", stream);
+    point.field("objectNumber", count_object)
+         .field("crackDefect", is_crack_defect)
+         .field("orientationDefect", is_orientation_defect)
+         .field("colorDefect", is_color_defect)
+         .field("complete", is_complete)
+         .timestamp(influx::now_ns());
+    writer.write(point);
+
+    return EXIT_SUCCESS;
+}
+
+/** Write the details of the object on the frame **/
+static void annotate(Mat &img, const DisplayItem &item, const string &output_string)
+{
+    putText(img, item.count_text, Point(5, 50), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
+    putText(img, item.height_text, Point(5, 80), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
+    putText(img, item.width_text, Point(5, 110), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
+    putText(img, output_string, Point(5, 140), FONT_HERSHEY_DUPLEX, 0.75, Scalar(255, 255, 255), 2);
+}
+
+Pipeline::Pipeline(VideoCapture &capture, const PipelineConfig &config, ThreadPool &pool, influx::AsyncWriter *writer,
+                   ImageWriter &images, ObjectRecorder *recorder)
+    : capture(capture), config(config), pool(pool), writer(writer), images(images), recorder(recorder),
+      frames(config.queue_size), objects(config.queue_size),
+      results(config.queue_size), display_items(config.queue_size),
+      stopped(false), frame_count(0), decoded_count(0), skipped_count(0), object_count(0), cascade(config.cascade)
+{
+}
+
+Pipeline::~Pipeline()
+{
+    stop();
+    join();
+}
+
+void Pipeline::start()
+{
+    // Build the color table before the first object, rather than stall the first color check
+    ColorTable::colorDefects();
+    capture_thread = thread(&Pipeline::captureStage, this);
+    segmentation_thread = thread(&Pipeline::segmentationStage, this);
+    analysis_thread = thread(&Pipeline::analysisStage, this);
+    output_thread = thread(&Pipeline::outputStage, this);
+}
+
+void Pipeline::stop()
+{
+    stopped = true;
+    frames.close();
+    objects.close();
+    results.close();
+    display_items.close();
+}
+
+void Pipeline::join()
+{
+    if (capture_thread.joinable())
+        capture_thread.join();
+    if (segmentation_thread.joinable())
+        segmentation_thread.join();
+    if (analysis_thread.joinable())
+        analysis_thread.join();
+    if (output_thread.joinable())
+        output_thread.join();
+}
+
+bool Pipeline::display()
+{
+    return display(vector<Pipeline*>{this});
+}
+
+/** Draw the trigger line and the text of the last inspected object on a live frame **/
+void Pipeline::prepareDisplay(DisplayItem &item, DisplayItem &last)
+{
+    if (!item.live)
+    {
+        last = item;
+        return;
+    }
+    // The frame may still be in use by the other stages
+    item.image = item.image.clone();
+    if (config.tracker.enabled)
+    {
+        if (config.tracker.axis == 'y')
+        {
+            int y = config.tracker.line * item.image.rows;
+            line(item.image, Point(0, y), Point(item.image.cols, y), Scalar(0, 255, 255), 1);
+        }
+        else
+        {
+            int x = config.tracker.line * item.image.cols;
+            line(item.image, Point(x, 0), Point(x, item.image.rows), Scalar(0, 255, 255), 1);
+        }
+    }
+    putText(item.image, "Press q to quit", Point(410, 50), FONT_HERSHEY_DUPLEX, 1, Scalar(255, 255, 255), 2);
+    annotate(item.image, last, "Defect : ");
+}
+
+bool Pipeline::display(const vector<Pipeline*> &pipelines)
+{
+    struct Window
+    {
+        Pipeline *pipeline;
+        string name;
+        DisplayItem last;                       // Last inspected object, its text stays on the live frames
+        chrono::steady_clock::time_point due;   // Time the next frame can be shown
+    };
+    const chrono::milliseconds poll_interval(5);
+    vector<Window> windows;
+    bool shown = false;
+    int KeyPressed; // Ascii value for the key pressed
+
+    for (Pipeline *pipeline : pipelines)
+    {
+        if (pipeline->config.headless)
+            continue;
+        Window window;
+        window.pipeline = pipeline;
+        window.name = pipeline->config.stream.empty() ? "Out" : "Out " + pipeline->config.stream;
+        window.last.count_text = "Object Number : 0";
+        window.due = chrono::steady_clock::now();
+        windows.push_back(window);
+    }
+
+    // Every window shows its next frame once the previous one has been shown for its delay
+    while (!windows.empty())
+    {
+        auto now = chrono::steady_clock::now();
+        auto next = now + poll_interval;
+        for (auto window = windows.begin(); window != windows.end(); )
+        {
+            DisplayItem item;
+            if (window->due <= now)
+            {
+                if (window->pipeline->display_items.try_pop(item))
+                {
+                    window->pipeline->prepareDisplay(item, window->last);
+                    imshow(window->name, item.image);
+                    window->due = now + chrono::milliseconds(item.delay);
+                    shown = true;
+                }
+                else if (window->pipeline->display_items.drained())
+                {
+                    window = windows.erase(window);
+                    continue;
+                }
+            }
+            if (window->due > now)
+                next = min(next, window->due);
+            ++window;
+        }
+
+        int wait = max(1, (int)chrono::duration_cast<chrono::milliseconds>(next - now).count());
+        if (!shown)
+        {
+            this_thread::sleep_for(chrono::milliseconds(wait));
+            continue;
+        }
+        KeyPressed = waitKey(wait);
+        if (KeyPressed == 113 || KeyPressed == 81) // Ascii value of Q = 81 and q = 113
+        {
+            for (Pipeline *pipeline : pipelines)
+                pipeline->stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Read the frames from the stream. Only the frames to be analysed or shown are retrieved **/
+void Pipeline::captureStage()
+{
+    // Enough buffers for the frames waiting in the queues and the ones being processed
+    FramePool frame_pool(4 * config.queue_size + 4);
+    bool grabbed;
+
+    while (!stopped)
+    {
+        {
+            StageTimer timer(STAGE_CAPTURE);
+            grabbed = capture.grab();
+        }
+        if (!grabbed)
+        {
+            cout << (config.stream.empty() ? "" : "[" + config.stream + "] ") << "Video stream ended" << endl;
+            break;
+        }
+        long index = ++frame_count;
+
+        // Every frame is needed to follow the objects when tracking
+        bool analysed = config.tracker.enabled || index % config.sample_interval == 0;
+        bool shown = !config.headless && index % config.display_interval == 0;
+        if (!analysed && !shown)
+        {
+            skipped_count++;
+            continue;
+        }
+
+        // The buffer of a previous frame is only reused once the later stages are done with it
+        Frame frame;
+        frame.image = frame_pool.acquire();
+        {
+            StageTimer timer(STAGE_RETRIEVE);
+            capture.retrieve(frame.image);
+        }
+        if (frame.image.empty())
+        {
+            cout << (config.stream.empty() ? "" : "[" + config.stream + "] ") << "Video stream ended" << endl;
+            break;
+        }
+        frame_pool.keep(frame.image);
+        decoded_count++;
+        frame.index = index;
+
+        if (analysed)
+        {
+            if (!frames.push(frame))
+                break;
+        }
+        if (shown)
+        {
+            // Shown for as long as the frames skipped would have been, so that the stream keeps its speed
+            // A borrowed frame is copied, the display may hold it for longer than the ring can wait
+            DisplayItem item;
+            item.image = isBorrowed(frame.image) ? frame.image.clone() : frame.image;
+            item.delay *= config.display_interval;
+            if (!display_items.push(item))
+                break;
+        }
+    }
+    frames.close();
+}
+
+/** Find the objects on the sampled frames **/
+void Pipeline::segmentationStage()
+{
+    Frame frame;
+    Rect object;
+    CentroidTracker tracker(config.tracker);
+    vector<ObjectSample> candidates, tracked;
+    // The contours of a frame are shared by its objects until they are analysed. In flight are the lists held by the
+    // two queues up to the output stage, the ones of the stages, and with the tracker the best samples of the tracks
+    SharedPool<vector<vector<Point>>> contour_pool(2 * config.queue_size + 4 + (config.tracker.enabled ? TRACKED_SAMPLES : 0));
+
+    while (frames.pop(frame))
+    {
+        auto contours = contour_pool.acquire();
+        locateObjects(frame.image, config.localization_scale, *contours, config.blob_prefilter);
+
+        candidates.clear();
+        for (size_t contour = 0; contour < contours->size(); contour++)
+        {
+            object = boundingRect((*contours)[contour]);
+            if (object.width * object.height > OBJECT_AREA_MIN && OBJECT_AREA_MAX > object.width * object.height)
+            {
+                // The objects outlive the frame in the queues, the tracker and the image writer. A borrowed frame is
+                // copied once for all of them, so that its slot goes back to the ring as soon as it is segmented
+                if (isBorrowed(frame.image))
+                    frame.image = frame.image.clone();
+                ObjectSample sample;
+                sample.frame_index = frame.index;
+                sample.frame = frame.image;
+                sample.object = object;
+                sample.roi = Rect(0, 0, frame.image.cols, frame.image.rows);
+                if (config.roi_detection)
+                {
+                    Rect region(object.x - config.roi_margin, object.y - config.roi_margin,
+                                object.width + 2 * config.roi_margin, object.height + 2 * config.roi_margin);
+                    sample.roi &= region;
+                }
+                sample.contours = contours;
+                sample.contour_index = contour;
+                candidates.push_back(sample);
+            }
+        }
+
+        // Keep only the objects at their best centred frame
+        if (config.tracker.enabled)
+            tracker.update(candidates, frame.image.size(), tracked);
+        if (!queueObjects(config.tracker.enabled ? tracked : candidates))
+            return;
+        // A borrowed frame goes back to the ring now rather than after the wait for the next one
+        frame.image.release();
+    }
+    if (config.tracker.enabled)
+    {
+        tracker.flush(tracked);
+        queueObjects(tracked);
+        if (tracker.tracks_started_past() > 0)
+            cout << (config.stream.empty() ? "" : "[" + config.stream + "] ") << tracker.tracks_started_past()
+                 << " objects were first seen past the trigger line and inspected on their first frame" << endl;
+    }
+    objects.close();
+}
+
+/** Number and measure the objects to be inspected and hand them to the analysis **/
+bool Pipeline::queueObjects(vector<ObjectSample> &samples)
+{
+    for (auto &sample : samples)
+    {
+        sample.number = ++object_count;
+        sample.measurement = measureObject((*sample.contours)[sample.contour_index], config.one_pixel_length);
+        if (!objects.push(sample))
+            return false;
+    }
+    return true;
+}
+
+/** Run one defect detector on an object and measure its time **/
+DefectResult Pipeline::runDetector(Detector detector, const ObjectSample &sample, const Mat &view, Rect object,
+                                   ObjectOrientation &axis, uint64_t &ns) const
+{
+    DefectResult result;
+    auto start = chrono::steady_clock::now();
+    switch (detector)
+    {
+    case DETECTOR_ORIENTATION:
+    {
+        StageTimer timer(STAGE_ORIENTATION);
+        result = detectOrientation(view, (*sample.contours)[sample.contour_index], object, &axis);
+        break;
+    }
+    case DETECTOR_COLOR:
+    {
+        StageTimer timer(STAGE_COLOR);
+        result = detectColor(view, object, config.blob_prefilter);
+        break;
+    }
+    default:
+    {
+        StageTimer timer(STAGE_CRACK);
+        if (config.masked_crack_detection)
+            result = detectCrackInMask(view, (*sample.contours)[sample.contour_index], object, -sample.roi.tl());
+        else
+            result = detectCrack(view, object);
+        break;
+    }
+    }
+    ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/** Check the occurence of defects in the objects. The detectors of one object run concurrently,
+ ** or one after another up to the first defect in cascade mode **/
+void Pipeline::analysisStage()
+{
+    ObjectSample sample;
+    TaskGroup detectors;
+    string log_prefix = config.stream.empty() ? "" : "[" + config.stream + "] ";
+
+    if (cascade.enabled())
+        cout << log_prefix << "Detector cascade order: " << cascade.order_text() << endl;
+    while (objects.pop(sample))
+    {
+        InspectionResult result;
+        // View of the region to inspect, it shares the pixels of the frame
+        Mat view = sample.frame(sample.roi);
+        Rect rect = sample.object - sample.roi.tl();
+        ObjectOrientation &axis = result.axis;
+        DefectResult *outcomes[DETECTOR_COUNT] = {&result.orientation, &result.color, &result.crack};
+        uint64_t ns[DETECTOR_COUNT] = {};
+        bool audit = !cascade.enabled() || cascade.auditNext();
+
+        if (audit)
+        {
+            // The tasks live on this stack until the group is waited for, so posting them does not allocate
+            auto orientation = [&]
+            {
+                result.orientation = runDetector(DETECTOR_ORIENTATION, sample, view, rect, axis, ns[DETECTOR_ORIENTATION]);
+            };
+            auto color = [&]
+            {
+                result.color = runDetector(DETECTOR_COLOR, sample, view, rect, axis, ns[DETECTOR_COLOR]);
+            };
+            pool.post(orientation, detectors);
+            pool.post(color, detectors);
+
+            // The crack detector runs on this thread while the others run on the pool
+            result.crack = runDetector(DETECTOR_CRACK, sample, view, rect, axis, ns[DETECTOR_CRACK]);
+            detectors.wait();
+            if (cascade.enabled())
+                for (int detector = 0; detector < DETECTOR_COUNT; detector++)
+                    cascade.record((Detector)detector, ns[detector], outcomes[detector]->defect);
+        }
+        else
+        {
+            // Up to the first defect, the object is rejected whatever the other detectors would find
+            for (Detector detector : cascade.order())
+            {
+                *outcomes[detector] = runDetector(detector, sample, view, rect, axis, ns[detector]);
+                cascade.record(detector, ns[detector], outcomes[detector]->defect);
+                if (outcomes[detector]->defect)
+                {
+                    result.complete = detector == cascade.order().back();
+                    break;
+                }
+            }
+        }
+        if (cascade.enabled() && cascade.finishObject(audit))
+            cout << log_prefix << "Detector cascade order: " << cascade.order_text() << endl;
+
+        result.sample = sample;
+        if (!results.push(result))
+            return;
+    }
+    results.close();
+}
+
+/** Queue the images of the objects to be saved, write the defects to influxDB and the records, and hand the frames to the display **/
+void Pipeline::outputStage()
+{
+    InspectionResult result;
+    influx::LineBuilder point;
+    char text[200];
+    string log_prefix = config.stream.empty() ? "" : "[" + config.stream + "] ";
+
+    while (results.pop(result))
+    {
+        const ObjectSample &sample = result.sample;
+        Rect object = sample.object;
+        DisplayItem item;
+        string output_string = "Defect : ";
+
+        item.live = false;
+        item.delay = 2000;
+        sprintf(text, "Object Number : %d", sample.number);
+        item.count_text = text;
+        sprintf(text, "Length (mm) = %.2f", sample.measurement[0]);
+        item.height_text = text;
+        sprintf(text, "Width (mm)  = %.2f", sample.measurement[1]);
+        item.width_text = text;
+
+        if (sample.track_id > 0)
+            cout << log_prefix << "Object " << sample.number << " is track " << sample.track_id << " at frame " << sample.frame_index << endl;
+        if (result.orientation.defect)
+        {
+            cout << log_prefix << "Orientation defect detected in object " << sample.number;
+            if (result.axis.eccentricity > 0)
+                cout << " (angle " << result.axis.angle << " rad, eccentricity " << result.axis.eccentricity
+                     << ", confidence " << result.axis.confidence << ")";
+            cout << endl;
+            output_string = output_string + "Orientation" + " ";
+        }
+        if (result.color.defect)
+        {
+            cout << log_prefix << "Color defect detected in object " << sample.number << endl;
+            output_string = output_string + "Color" + " ";
+        }
+        if (result.crack.defect)
+        {
+            cout << log_prefix << "Crack detected in object " << sample.number << endl;
+            output_string = output_string + "Crack" + " ";
+        }
+        if (!result.complete)
+            cout << log_prefix << "Other checks of object " << sample.number << " skipped by the detector cascade" << endl;
+
+        uint8_t defects = (result.orientation.defect ? CROP_ORIENTATION : 0) | (result.color.defect ? CROP_COLOR : 0) |
+                          (result.crack.defect ? CROP_CRACK : 0);
+        const struct
+        {
+            const DefectResult &defect;
+            const char *dir_name;
+        } outputs[] = {{result.orientation, "orientation"}, {result.color, "color"}, {result.crack, "crack"}};
+
+        for (const auto &output : outputs)
+        {
+            if (!output.defect.defect)
+                continue;
+            Mat img = output.defect.image;
+            bool full_frame = img.size() == sample.frame.size();
+            if (full_frame)
+                annotate(img, item, output_string);
+            images.save(output.dir_name, config.stream, sample.number, img(object - sample.roi.tl()), defects, sample.measurement[0], sample.measurement[1]);
+            if (!config.headless)
+            {
+                // Put the inspected region back on the frame for display
+                if (!full_frame)
+                {
+                    Mat view = sample.frame.clone();
+                    img.copyTo(view(sample.roi));
+                    annotate(view, item, output_string);
+                    img = view;
+                }
+                item.image = img;
+                display_items.push(item);
+            }
+        }
+
+        // Display and save the object with no defect
+        if (!result.orientation.defect && !result.color.defect && !result.crack.defect)
+        {
+            output_string = output_string + "No Defect" + " ";
+            cout << log_prefix << "No defect detected in object " << sample.number << endl;
+            images.save("no_defect", config.stream, sample.number, sample.frame(Rect(object.tl(), object.br())), 0, sample.measurement[0], sample.measurement[1]);
+            if (!config.headless)
+            {
+                item.image = sample.frame.clone();
+                annotate(item.image, item, output_string);
+                display_items.push(item);
+            }
+        }
+
+        if (writer != nullptr)
+            writeToInfluxDB(*writer, point, config.stream, sample.number, result.crack.defect, result.orientation.defect, result.color.defect, result.complete);
+        if (recorder != nullptr)
+            recorder->record(config.stream, result);
+        cout << log_prefix << item.height_text << " " << item.width_text << endl;
+    }
+    display_items.close();
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include <chrono>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <thread>
+# include <unistd.h>
+# include "shm_ring.h"
+
+using namespace cv;
+using namespace std;
+
+// Time the consumer waits for a frame before it ends the stream
+#define SHM_IDLE_TIMEOUT_MS 10000
+
+#if CV_VERSION_MAJOR >= 4
+typedef AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+static size_t alignUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static string shmName(const string &name)
+{
+    return "/" + name;
+}
+
+ShmRing::ShmRing(const string &name, void *memory, size_t size, bool owner)
+    : name(name), memory(memory), size(size), owner(owner), header((ShmRingHeader*)memory)
+{
+    released.assign(header->slot_count, false);
+}
+
+ShmRing::~ShmRing()
+{
+    munmap(memory, size);
+    if (owner)
+        shm_unlink(shmName(name).c_str());
+}
+
+shared_ptr<ShmRing> ShmRing::create(const string &name, int slot_count, int width, int height, int type, double fps)
+{
+    if (slot_count < 1 || width < 1 || height < 1)
+        return nullptr;
+    size_t step = alignUp((size_t)width * CV_ELEM_SIZE(type), 64);
+    size_t data_offset = alignUp(sizeof(ShmRingHeader), 4096);
+    size_t slot_size = alignUp(sizeof(ShmSlotHeader) + step * height, 4096);
+    size_t size = data_offset + slot_size * slot_count;
+
+    // A ring left by a producer which did not exit cleanly is replaced
+    shm_unlink(shmName(name).c_str());
+    int fd = shm_open(shmName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0)
+        return nullptr;
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        shm_unlink(shmName(name).c_str());
+        return nullptr;
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(shmName(name).c_str());
+        return nullptr;
+    }
+
+    // The new memory is zeroed, so the counters start at 0
+    ShmRingHeader *header = (ShmRingHeader*)memory;
+    header->version = SHM_RING_VERSION;
+    header->slot_count = slot_count;
+    header->width = width;
+    header->height = height;
+    header->type = type;
+    header->step = step;
+    header->slot_size = slot_size;
+    header->data_offset = data_offset;
+    header->fps = fps;
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+    return make_shared<ShmRing>(name, memory, size, true);
+}
+
+shared_ptr<ShmRing> ShmRing::open(const string &name)
+{
+    struct stat status;
+    int fd = shm_open(shmName(name).c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return nullptr;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(ShmRingHeader))
+    {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = status.st_size;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return nullptr;
+
+    ShmRingHeader *header = (ShmRingHeader*)memory;
+    bool valid = memcmp(header->magic, SHM_RING_MAGIC, sizeof(header->magic)) == 0;
+    atomic_thread_fence(memory_order_acquire);
+    if (!valid || header->version != SHM_RING_VERSION || header->slot_count == 0 ||
+        header->data_offset + header->slot_size * header->slot_count > size)
+    {
+        munmap(memory, size);
+        return nullptr;
+    }
+    return make_shared<ShmRing>(name, memory, size, false);
+}
+
+ShmSlotHeader *ShmRing::slot(uint64_t sequence) const
+{
+    return (ShmSlotHeader*)((uint8_t*)memory + header->data_offset + (sequence % header->slot_count) * header->slot_size);
+}
+
+void ShmRing::release(uint64_t sequence)
+{
+    lock_guard<mutex> guard(lock);
+    uint64_t read = header->read_sequence.load(memory_order_relaxed);
+    if (sequence < read)
+        return;
+    released[sequence % header->slot_count] = true;
+    while (released[read % header->slot_count])
+    {
+        released[read % header->slot_count] = false;
+        read++;
+    }
+    // The producer may overwrite the slots only once the frames before read are no longer read
+    header->read_sequence.store(read, memory_order_release);
+}
+
+ShmRingProducer::ShmRingProducer(const string &name, int slot_count, Size size, double fps)
+    : ring(ShmRing::create(name, slot_count, size.width, size.height, CV_8UC3, fps))
+{
+}
+
+ShmRingProducer::~ShmRingProducer()
+{
+    close();
+}
+
+bool ShmRingProducer::publish(const Mat &frame, uint64_t timestamp_ns, bool wait)
+{
+    if (ring == nullptr)
+        return false;
+    ShmRingHeader *header = ring->header;
+    if (frame.cols != (int)header->width || frame.rows != (int)header->height || frame.type() != (int)header->type)
+        return false;
+
+    uint64_t sequence = header->write_sequence.load(memory_order_relaxed);
+    while (sequence - header->read_sequence.load(memory_order_acquire) >= header->slot_count)
+    {
+        if (!wait)
+            return false;
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+
+    ShmSlotHeader *slot = ring->slot(sequence);
+    Mat pixels(header->height, header->width, header->type, ring->pixels(slot), header->step);
+    frame.copyTo(pixels);
+    slot->timestamp_ns = timestamp_ns;
+    slot->sequence.store(sequence, memory_order_relaxed);
+    header->write_sequence.store(sequence + 1, memory_order_release);
+    return true;
+}
+
+void ShmRingProducer::close()
+{
+    if (ring != nullptr)
+        ring->header->closed.store(1, memory_order_release);
+}
+
+/**
+ * @brief Frame of a ring handed out by ShmCapture, owned by the UMatData of its Mat
+ */
+struct ShmFrame
+{
+    shared_ptr<ShmRing> ring;
+    uint64_t sequence;
+};
+
+/**
+ * @brief Allocator of the Mats wrapping the slots of a ring. The pixels are never allocated or freed,
+ * the slot is given back to the producer when the last Mat sharing it is released
+ */
+class ShmAllocator : public MatAllocator
+{
+    public:
+        UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, AccessFlags flags, UMatUsageFlags usage) const override
+        {
+            // A Mat created again after wrapping a slot gets ordinary memory
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+        }
+
+        bool allocate(UMatData *data, AccessFlags flags, UMatUsageFlags usage) const override
+        {
+            return Mat::getStdAllocator()->allocate(data, flags, usage);
+        }
+
+        void deallocate(UMatData *data) const override
+        {
+            if (data == nullptr)
+                return;
+            ShmFrame *frame = (ShmFrame*)data->userdata;
+            frame->ring->release(frame->sequence);
+            delete frame;
+            delete data;
+        }
+};
+
+static ShmAllocator shm_allocator;
+
+ShmCapture::ShmCapture(const string &name) : ring(ShmRing::open(name))
+{
+    // Start with the oldest frame not released yet
+    if (ring != nullptr)
+        next_sequence = ring->header->read_sequence.load(memory_order_acquire);
+}
+
+ShmCapture::~ShmCapture()
+{
+    release();
+}
+
+int ShmCapture::slots() const
+{
+    return ring != nullptr ? ring->header->slot_count : 0;
+}
+
+bool ShmCapture::isOpened() const
+{
+    return ring != nullptr;
+}
+
+void ShmCapture::dropGrabbed()
+{
+    if (grabbed)
+        ring->release(grabbed_sequence);
+    grabbed = false;
+}
+
+bool ShmCapture::grab()
+{
+    if (ring == nullptr)
+        return false;
+    dropGrabbed();
+
+    ShmRingHeader *header = ring->header;
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(SHM_IDLE_TIMEOUT_MS);
+    while (header->write_sequence.load(memory_order_acquire) <= next_sequence)
+    {
+        // The producer closes the ring after publishing its last frame
+        if (header->closed.load(memory_order_acquire) && header->write_sequence.load(memory_order_acquire) <= next_sequence)
+            return false;
+        if (chrono::steady_clock::now() > deadline)
+            return false;
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+    grabbed_sequence = next_sequence++;
+    timestamp_ns = ring->slot(grabbed_sequence)->timestamp_ns;
+    grabbed = true;
+    return true;
+}
+
+bool ShmCapture::retrieve(OutputArray image, int flag)
+{
+    if (!grabbed)
+        return false;
+    const ShmRingHeader *header = ring->header;
+    Mat frame(header->height, header->width, header->type, ring->pixels(ring->slot(grabbed_sequence)), header->step);
+
+    // The Mat owns the slot from now on, like a numpy array owns the memory wrapped by the Python bindings
+    UMatData *data = new UMatData(&shm_allocator);
+    data->data = data->origdata = frame.data;
+    data->size = (size_t)header->step * header->height;
+    data->userdata = new ShmFrame{ring, grabbed_sequence};
+    frame.u = data;
+    frame.allocator = &shm_allocator;
+    frame.addref();
+    grabbed = false;
+
+    if (image.kind() == _InputArray::MAT)
+        image.getMatRef() = frame;
+    else
+        frame.copyTo(image);
+    return true;
+}
+
+bool ShmCapture::read(OutputArray image)
+{
+    if (grab())
+        return retrieve(image);
+    image.release();
+    return false;
+}
+
+double ShmCapture::get(int property) const
+{
+    if (ring == nullptr)
+        return 0;
+    switch (property)
+    {
+        case CAP_PROP_FRAME_WIDTH:
+            return ring->header->width;
+        case CAP_PROP_FRAME_HEIGHT:
+            return ring->header->height;
+        case CAP_PROP_FPS:
+            return ring->header->fps;
+        case CAP_PROP_POS_FRAMES:
+            return next_sequence;
+        case CAP_PROP_POS_MSEC:
+            return timestamp_ns / 1e6;
+        default:
+            return 0;
+    }
+}
+
+void ShmCapture::release()
+{
+    if (ring != nullptr)
+        dropGrabbed();
+    // The frames still used by the pipeline keep the ring mapped until they are released
+    ring.reset();
+}
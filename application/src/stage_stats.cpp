@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <memory>
+#include <vector>
+#include "stage_stats.h"
+
+using namespace std;
+
+static const char *stage_names[STAGE_COUNT] = {"capture", "retrieve", "segmentation", "findContours", "orientation", "color", "crack",
+                                               "imageWrite", "databaseWrite"};
+
+const char *stage_name(Stage stage)
+{
+    return stage_names[stage];
+}
+
+int LatencyHistogram::bucket(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+    int exponent = 63 - __builtin_clzll(value);
+    int index = (exponent - 3) * SUB_BUCKETS + ((value >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::bucket_limit(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    int exponent = index / SUB_BUCKETS + 3;
+    uint64_t sub_bucket = index % SUB_BUCKETS;
+    // Largest value falling in the bucket
+    return ((SUB_BUCKETS + sub_bucket + 1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    counts[bucket(ns)]++;
+    total++;
+    sum += ns;
+    if (ns > maximum)
+        maximum = ns;
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other)
+{
+    for (int index = 0; index < BUCKETS; index++)
+        counts[index] += other.counts[index];
+    total += other.total;
+    sum += other.sum;
+    if (other.maximum > maximum)
+        maximum = other.maximum;
+}
+
+void LatencyHistogram::reset()
+{
+    for (int index = 0; index < BUCKETS; index++)
+        counts[index] = 0;
+    total = 0;
+    sum = 0;
+    maximum = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if (total == 0)
+        return 0;
+    uint64_t rank = fraction * total, seen = 0;
+    for (int index = 0; index < BUCKETS; index++)
+    {
+        seen += counts[index];
+        if (seen > rank)
+            return std::min(bucket_limit(index), maximum);
+    }
+    return maximum;
+}
+
+/**
+ * @brief Histograms of one thread. The lock is only shared with the collection, so it is almost never contended
+ */
+struct ThreadLatencies
+{
+    mutex lock;
+    LatencyHistogram histograms[STAGE_COUNT];
+};
+
+static atomic<bool> recording(false);
+static mutex registry_lock;
+// Kept after the thread ends, so that its last latencies are still collected
+static vector<shared_ptr<ThreadLatencies>> registry;
+
+static ThreadLatencies &threadLatencies()
+{
+    thread_local shared_ptr<ThreadLatencies> latencies;
+    if (!latencies)
+    {
+        latencies = make_shared<ThreadLatencies>();
+        lock_guard<mutex> guard(registry_lock);
+        registry.push_back(latencies);
+    }
+    return *latencies;
+}
+
+void recordLatency(Stage stage, uint64_t ns)
+{
+    ThreadLatencies &latencies = threadLatencies();
+    lock_guard<mutex> guard(latencies.lock);
+    latencies.histograms[stage].record(ns);
+}
+
+void collectLatencies(LatencyHistogram (&histograms)[STAGE_COUNT])
+{
+    lock_guard<mutex> guard(registry_lock);
+    for (auto &latencies : registry)
+    {
+        lock_guard<mutex> thread_guard(latencies->lock);
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            histograms[stage].add(latencies->histograms[stage]);
+            latencies->histograms[stage].reset();
+        }
+    }
+}
+
+void enableLatencies(bool enabled)
+{
+    recording = enabled;
+}
+
+bool latenciesEnabled()
+{
+    return recording.load(memory_order_relaxed);
+}
+
+#ifdef COUNT_ALLOCATIONS
+static atomic<uint64_t> allocation_calls[STAGE_COUNT];
+static atomic<uint64_t> allocation_totals[STAGE_COUNT];
+static atomic<uint64_t> allocation_free[STAGE_COUNT];
+
+void recordAllocations(Stage stage, uint64_t allocations)
+{
+    allocation_calls[stage].fetch_add(1, memory_order_relaxed);
+    allocation_totals[stage].fetch_add(allocations, memory_order_relaxed);
+    if (allocations == 0)
+        allocation_free[stage].fetch_add(1, memory_order_relaxed);
+}
+
+AllocationCount stageAllocations(Stage stage)
+{
+    AllocationCount count;
+    count.calls = allocation_calls[stage].load();
+    count.allocations = allocation_totals[stage].load();
+    count.allocation_free_calls = allocation_free[stage].load();
+    return count;
+}
+#endif
+
+StatsReporter::StatsReporter(influx::AsyncWriter &writer, int interval_ms)
+    : writer(writer), interval(interval_ms > 0 ? interval_ms : 5000)
+{
+    enableLatencies(true);
+    worker = thread(&StatsReporter::run, this);
+}
+
+StatsReporter::~StatsReporter()
+{
+    close();
+}
+
+void StatsReporter::run()
+{
+    unique_lock<mutex> guard(lock);
+    while (!stopping)
+    {
+        wake.wait_for(guard, interval, [this] { return stopping; });
+        guard.unlock();
+        publish();
+        guard.lock();
+    }
+}
+
+/** Queue one point per stage with the latencies recorded since the last publication **/
+void StatsReporter::publish()
+{
+    influx::LineBuilder point;
+    long long timestamp = influx::now_ns();
+
+    collectLatencies(current);
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        const LatencyHistogram &histogram = current[stage];
+        if (histogram.count() == 0)
+            continue;
+        point.clear();
+        point.measure("PipelineStats")
+             .tag("stage", stage_names[stage])
+             .field("count", (long long)histogram.count())
+             .field("p50_us", histogram.percentile(0.5) / 1e3)
+             .field("p99_us", histogram.percentile(0.99) / 1e3)
+             .field("mean_us", histogram.mean() / 1e3)
+             .field("max_us", histogram.max() / 1e3)
+             .timestamp(timestamp);
+        writer.write(point);
+        totals[stage].add(histogram);
+        current[stage].reset();
+    }
+}
+
+void StatsReporter::close()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        if (stopping)
+            return;
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+    enableLatencies(false);
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "tracker.h"
+
+using namespace cv;
+using namespace std;
+
+static Point2f centroidOf(const Rect &object)
+{
+    return Point2f(object.x + object.width / 2.0f, object.y + object.height / 2.0f);
+}
+
+CentroidTracker::CentroidTracker(const TrackerConfig &config) : config(config)
+{
+}
+
+// Signed distance of the centroid from the trigger line
+float CentroidTracker::lineOffset(const Point2f &centroid, Size frame_size) const
+{
+    if (config.axis == 'y')
+        return centroid.y - config.line * frame_size.height;
+    return centroid.x - config.line * frame_size.width;
+}
+
+void CentroidTracker::update(const vector<ObjectSample> &candidates, Size frame_size, vector<ObjectSample> &ready)
+{
+    ready.clear();
+    track_matched.assign(tracks.size(), false);
+    candidate_matched.assign(candidates.size(), false);
+    pairs.clear();
+
+    // Greedy association, the closest pairs first
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            Point2f delta = centroidOf(candidates[c].object) - tracks[t].centroid;
+            float distance = sqrt(delta.x * delta.x + delta.y * delta.y);
+            if (distance < config.max_distance)
+                pairs.push_back(make_pair(distance, make_pair(t, c)));
+        }
+    }
+    sort(pairs.begin(), pairs.end());
+
+    for (const auto &match : pairs)
+    {
+        size_t t = match.second.first, c = match.second.second;
+        if (track_matched[t] || candidate_matched[c])
+            continue;
+        track_matched[t] = candidate_matched[c] = true;
+
+        Track &track = tracks[t];
+        track.centroid = centroidOf(candidates[c].object);
+        track.missed = 0;
+        if (track.done)
+            continue;
+
+        float offset = lineOffset(track.centroid, frame_size);
+        track.receding = fabs(offset) > track.best_distance + config.jitter ? track.receding + 1 : 0;
+        if ((offset >= 0) != track.positive_side)
+            track.crossed = true;
+        // A track moving away from the line without crossing it started past it. The centroids wobble by a few
+        // pixels, so a single step back of an object coming to the line is not taken for it
+        else if (!track.crossed && track.receding >= config.receding_frames)
+        {
+            track.crossed = true;
+            started_past++;
+        }
+        if (fabs(offset) < track.best_distance)
+        {
+            track.best_distance = fabs(offset);
+            track.best = candidates[c];
+        }
+        // Once past the line the object only moves away from it, the best sample is final
+        else if (track.crossed)
+        {
+            // The sample is handed over and not kept, so the frame it holds is released once inspected
+            track.best.track_id = track.id;
+            ready.push_back(std::move(track.best));
+            track.best = ObjectSample();
+            track.done = true;
+        }
+    }
+
+    // Age the tracks which were not seen on this frame
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+        if (!track_matched[t])
+            tracks[t].missed++;
+    }
+    for (auto track = tracks.begin(); track != tracks.end();)
+    {
+        if (track->missed > config.max_missed)
+        {
+            if (track->crossed && !track->done)
+            {
+                track->best.track_id = track->id;
+                ready.push_back(std::move(track->best));
+            }
+            track = tracks.erase(track);
+        }
+        else
+            ++track;
+    }
+
+    // Start a track for every new object
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        if (candidate_matched[c])
+            continue;
+        Track track;
+        track.id = ++next_id;
+        track.centroid = centroidOf(candidates[c].object);
+        track.missed = 0;
+        float offset = lineOffset(track.centroid, frame_size);
+        track.positive_side = offset >= 0;
+        track.crossed = false;
+        track.done = false;
+        track.receding = 0;
+        track.best_distance = fabs(offset);
+        track.best = candidates[c];
+        tracks.push_back(track);
+    }
+}
+
+void CentroidTracker::flush(vector<ObjectSample> &ready)
+{
+    ready.clear();
+    for (auto &track : tracks)
+    {
+        if (track.crossed && !track.done)
+        {
+            track.best.track_id = track.id;
+            ready.push_back(std::move(track.best));
+        }
+    }
+    tracks.clear();
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Lists the images of an archive written by the application and extracts them to files
+ *
+ * Usage:
+ *   crop-archive list <prefix>
+ *   crop-archive extract <prefix> <output directory> [object number]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "crop_archive.h"
+
+using namespace cv;
+using namespace std;
+
+static const char *encoding_names[] = {"png", "jpg", "raw"};
+
+static string defect_names(uint8_t defects)
+{
+    string names;
+    if (defects & CROP_ORIENTATION)
+        names += "orientation ";
+    if (defects & CROP_COLOR)
+        names += "color ";
+    if (defects & CROP_CRACK)
+        names += "crack ";
+    return names.empty() ? "none" : names.substr(0, names.size() - 1);
+}
+
+static void list(const CropArchiveReader &reader)
+{
+    printf("%-8s %-10s %-12s %-26s %-10s %-8s %-8s %-5s %s\n", "segment", "stream", "object", "defects", "size", "length", "width", "enc", "bytes");
+    for (const auto &crop : reader.images())
+    {
+        const CropIndexEntry &entry = *crop.entry;
+        char size[16];
+        snprintf(size, sizeof(size), "%dx%d", entry.cols, entry.rows);
+        printf("%-8d %-10s %-12d %-26s %-10s %-8.2f %-8.2f %-5s %u\n", crop.segment, reader.stream_name(entry.stream).c_str(), entry.number, defect_names(entry.defects).c_str(),
+               size, entry.length, entry.width, encoding_names[entry.encoding % 3], entry.size);
+    }
+    cout << reader.images().size() << " images" << endl;
+}
+
+static bool extract(const CropArchiveReader &reader, const CropArchiveReader::Crop &crop, const string &directory)
+{
+    const CropIndexEntry &entry = *crop.entry;
+    // Prefix the files with the stream when the archive holds several of them
+    string stream = reader.stream_name(entry.stream);
+    string category = string(crop_categories[entry.category % 4]) + (stream.empty() ? "" : "_" + stream);
+    if (entry.encoding == CROP_RAW)
+    {
+        // The pixels are stored as they are, write them as a PNG file
+        Mat image(entry.rows, entry.cols, CV_8UC(entry.channels), (void*)crop.data);
+        return imwrite(format("%s/%s_object_%d.png", directory.c_str(), category.c_str(), entry.number), image);
+    }
+    string path = format("%s/%s_object_%d.%s", directory.c_str(), category.c_str(), entry.number, encoding_names[entry.encoding % 3]);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+    bool written = fwrite(crop.data, 1, entry.size, file) == entry.size;
+    return fclose(file) == 0 && written;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || (strcmp(argv[1], "list") != 0 && strcmp(argv[1], "extract") != 0) ||
+        (strcmp(argv[1], "extract") == 0 && argc < 4))
+    {
+        cout << "Usage: " << argv[0] << " list <prefix>" << endl;
+        cout << "       " << argv[0] << " extract <prefix> <output directory> [object number]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    CropArchiveReader reader;
+    if (!reader.open(argv[2]))
+    {
+        cout << "Could not open the archive " << argv[2] << endl;
+        return EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "list") == 0)
+    {
+        list(reader);
+        return EXIT_SUCCESS;
+    }
+
+    int extracted = 0;
+    for (const auto &crop : reader.images())
+    {
+        if (argc > 4 && crop.entry->number != atoi(argv[4]))
+            continue;
+        if (!extract(reader, crop, argv[3]))
+        {
+            cout << "Could not extract object " << crop.entry->number << " to " << argv[3] << endl;
+            return EXIT_FAILURE;
+        }
+        extracted++;
+    }
+    cout << "Extracted " << extracted << " images" << endl;
+    return EXIT_SUCCESS;
+}
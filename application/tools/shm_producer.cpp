@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2018-2019 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @brief Reference producer of a shared memory ring: replays a video into the ring, as a grabber process would with a camera
+ *
+ * Usage:
+ *   shm-producer [-n slots] [-l] [-r] [-d] <video> <name>
+ *
+ *   -n  Number of frames the ring holds (16 by default, at least queue_size + 2 of the application)
+ *   -l  Loop over the video until interrupted
+ *   -r  Publish the frames at the frame rate of the video instead of as fast as they are read
+ *   -d  Drop the frames when the ring is full, like a camera that cannot wait, instead of waiting for the consumer
+ *
+ * The application reads the ring with "shm://<name>" as the video of an input in config.json.
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "shm_ring.h"
+
+using namespace cv;
+using namespace std;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int)
+{
+    interrupted = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int slots = 16, opt;
+    bool loop = false, realtime = false, drop = false;
+
+    while ((opt = getopt(argc, argv, "n:lrd")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            slots = atoi(optarg);
+            break;
+        case 'l':
+            loop = true;
+            break;
+        case 'r':
+            realtime = true;
+            break;
+        case 'd':
+            drop = true;
+            break;
+        default:
+            optind = argc + 1;
+        }
+    }
+    if (argc - optind != 2 || slots < 1)
+    {
+        cout << "Usage: " << argv[0] << " [-n slots] [-l] [-r] [-d] <video> <name>" << endl;
+        return EXIT_FAILURE;
+    }
+    string video = argv[optind], name = argv[optind + 1];
+
+    VideoCapture capture(video);
+    if (!capture.isOpened())
+    {
+        cout << "Could not open the video " << video << endl;
+        return EXIT_FAILURE;
+    }
+    Size size(capture.get(CAP_PROP_FRAME_WIDTH), capture.get(CAP_PROP_FRAME_HEIGHT));
+    double fps = capture.get(CAP_PROP_FPS);
+    ShmRingProducer producer(name, slots, size, fps);
+    if (!producer.isOpened())
+    {
+        cout << "Could not create the shared memory ring " << name << endl;
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+    cout << "Publishing " << video << " (" << size.width << "x" << size.height << ") to " << SHM_INPUT_PREFIX << name
+         << " with " << slots << " slots" << endl;
+
+    Mat frame;
+    long published = 0, dropped = 0;
+    auto period = chrono::duration<double>(realtime && fps > 0 ? 1 / fps : 0);
+    auto due = chrono::steady_clock::now();
+    while (!interrupted)
+    {
+        if (!capture.read(frame))
+        {
+            if (!loop || !capture.set(CAP_PROP_POS_FRAMES, 0) || !capture.read(frame))
+                break;
+        }
+        if (realtime)
+        {
+            due += chrono::duration_cast<chrono::steady_clock::duration>(period);
+            this_thread::sleep_until(due);
+        }
+        uint64_t timestamp = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        // Waits here rather than in publish(), so that an interrupt still ends the producer while the ring is full
+        bool sent = producer.publish(frame, timestamp, false);
+        while (!sent && !drop && !interrupted)
+        {
+            this_thread::sleep_for(chrono::microseconds(200));
+            sent = producer.publish(frame, timestamp, false);
+        }
+        if (sent)
+            published++;
+        else
+            dropped++;
+    }
+    producer.close();
+    cout << "Frames published: " << published << ", dropped: " << dropped << endl;
+    return EXIT_SUCCESS;
+}